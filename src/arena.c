@@ -0,0 +1,79 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+
+static size_t align_up(size_t n) {
+        return (n + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static arena_block_t *new_block(size_t size, arena_block_t *prev) {
+        // the header and the data share one allocation, the data starts at the next aligned address
+        arena_block_t *block = (arena_block_t *)malloc(sizeof(arena_block_t) + ARENA_ALIGNMENT + size);
+        assert(block != NULL);
+
+        block->prev = prev;
+        block->size = size;
+        block->used = 0;
+        block->data = (char *)(((uintptr_t)(block + 1) + ARENA_ALIGNMENT - 1) & ~(uintptr_t)(ARENA_ALIGNMENT - 1));
+        return block;
+}
+
+static void free_blocks(arena_block_t *block) {
+        while (block != NULL) {
+                arena_block_t *prev = block->prev;
+                free(block);
+                block = prev;
+        }
+}
+
+// make sure size bytes fit into the current block, only call it on an empty arena
+void arena_reserve(arena_t *arena, size_t size) {
+        assert(arena->block == NULL || (arena->block->used == 0 && arena->block->prev == NULL));
+        size = align_up(size);
+        if (arena->block != NULL && arena->block->size >= size) return;
+
+        free_blocks(arena->block);
+        arena->block = new_block(size, NULL);
+}
+
+// ARENA_ALIGNMENT aligned, never NULL
+void *arena_alloc(arena_t *arena, size_t size) {
+        size = align_up(size);
+
+        arena_block_t *block = arena->block;
+        if (block == NULL || block->size - block->used < size) {
+                // at least double, a frame that keeps growing doesn't chain many small blocks
+                size_t block_size = block != NULL ? block->size * 2 : 0;
+                if (block_size < size) block_size = size;
+                block = arena->block = new_block(block_size, block);
+        }
+
+        void *ret = block->data + block->used;
+        block->used += size;
+        return ret;
+}
+
+// drop every allocation, O(1) unless the last round needed more than one block
+void arena_reset(arena_t *arena) {
+        arena_block_t *block = arena->block;
+        if (block == NULL) return;
+
+        // the new block covers the capacity of the whole chain, not just what was used,
+        // so it still satisfies an earlier arena_reserve() and the chain doesn't come back
+        if (block->prev != NULL) {
+                size_t total = 0;
+                for (arena_block_t *b = block; b != NULL; b = b->prev) total += b->size;
+
+                free_blocks(block);
+                arena->block = new_block(total, NULL);
+                return;
+        }
+
+        block->used = 0;
+}
+
+void arena_free(arena_t *arena) {
+        free_blocks(arena->block);
+        arena->block = NULL;
+}
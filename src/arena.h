@@ -0,0 +1,28 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+/*
+ * bump allocator for memory that lives until the next reset, e.g. one frame
+ * allocations are a pointer bump, a reset drops everything at once
+ * when a block runs out a new one is chained, the next reset replaces the chain
+ * with a single block of the combined size, so a steady workload stops allocating
+ */
+#define ARENA_ALIGNMENT 64 // cache line, neighbouring allocations filled by different threads don't share a line
+
+typedef struct arena_block {
+        struct arena_block *prev;
+        size_t size;
+        size_t used;
+        char *data; // ARENA_ALIGNMENT aligned
+} arena_block_t;
+
+typedef struct {
+        arena_block_t *block; // current block, NULL before the first allocation
+} arena_t;
+
+void arena_reserve(arena_t *arena, size_t size);
+void *arena_alloc(arena_t *arena, size_t size);
+void arena_reset(arena_t *arena);
+void arena_free(arena_t *arena);
+#endif
@@ -149,7 +149,8 @@ static int polygon_to_triangles(polygon_t *p, triangle_t *ret_triangles) {
                         .color = p->color,
                 };
         }
-        return p->num_vertices - 2;
+        // a polygon clipped away completely has no vertices left
+        return p->num_vertices < 3 ? 0 : p->num_vertices - 2;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
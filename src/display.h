@@ -3,11 +3,29 @@
 #include <SDL2/SDL.h>
 #include <stdbool.h>
 #include "vector.h"
+#include "texture.h"
+#include "triangle.h"
 #include <stdint.h>
 
 #define FPS 144
+
+// inclusive pixel bounds a draw call is allowed to touch, NULL means the whole window
+typedef struct {
+        int x_min;
+        int y_min;
+        int x_max;
+        int y_max;
+} rect_t;
+
 #define FRAME_TARGET_TIME (1000 / FPS)
 
+// how many pixels of a textured span share one exact perspective divide
+enum perspective_span {
+        PERSPECTIVE_EXACT = 0,
+        PERSPECTIVE_SPAN_8 = 8,
+        PERSPECTIVE_SPAN_16 = 16,
+};
+
 // TODO(@k): reduce the num of global variables
 extern SDL_Window *window;
 extern SDL_Renderer *renderer;
@@ -18,32 +36,30 @@ extern int window_width;
 extern int window_height;
 
 bool initialize_window(void);
+bool initialize_headless(void);
 void draw_grid(uint32_t color);
-void draw_rect(int x, int y, int width, int height, uint32_t color);
-void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color);
+void draw_rect(int x, int y, int width, int height, uint32_t color, const rect_t *clip);
+void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint32_t color, const rect_t *clip);
 void draw_filled_triangle(
         int x0, int y0, float z0, float w0,
         int x1, int y1, float z1, float w1,
         int x2, int y2, float z2, float w2,
         float *z_buffer, uint32_t color
 );
-void draw_filled_triangle_v2(
-        vec4_t *a,
-        vec4_t *b,
-        vec4_t *c,
-        float *z_buffer, uint32_t color
-);
+void draw_filled_triangle_v2(const raster_triangle_t *triangle, float *z_buffer, const rect_t *clip);
 void draw_textured_triangle(
-        int x0, int y0, float z0, float w0, float u0, float v0,
-        int x1, int y1, float z1, float w1, float u1, float v1,
-        int x2, int y2, float z2, float w2, float u2, float v2,
-        float *z_buffer, uint32_t *texture, int texture_width, int texture_height
+        const raster_triangle_t *triangle,
+        const raster_texcoords_t *uv,
+        float *z_buffer, const mip_level_t *mips,
+        enum perspective_span perspective_span,
+        const rect_t *clip
 );
-void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color, const rect_t *clip);
 void draw_pixel(int x, int y, uint32_t color);
 void draw_simple_integer(int number, int x_start, int y_start, int width);
 void clear_color_buffer(uint32_t color);
 void clear_z_buffer(float *z_buffer, int len);
 void destroy_window(void);
 void render_color_buffer(void);
+bool write_color_buffer_ppm(const char *path);
 #endif
@@ -0,0 +1,233 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "display.h"
+#include "golden.h"
+
+#define GOLDEN_HASHES "hashes.txt"
+#define MAX_GOLDEN_HASHES 64
+
+// fingerprint of one captured scene, see golden_hash()
+typedef struct {
+        char name[64];
+        uint64_t color;
+        uint64_t depth;
+} golden_hash_t;
+
+// written by golden_write(), saved by golden_save_hashes()
+static golden_hash_t written[MAX_GOLDEN_HASHES];
+static int num_written = 0;
+
+// the scale in the header of a pfm file is negative for little-endian floats
+static bool is_little_endian(void) {
+        uint16_t probe = 1;
+        return *(uint8_t *)&probe == 1;
+}
+
+// z_buffer as a single channel portable float map, rows are stored bottom to top
+static bool write_z_buffer_pfm(const char *path) {
+        FILE *fp = fopen(path, "wb");
+        if (!fp) {
+                fprintf(stderr, "failed to open file %s\n", path);
+                return false;
+        }
+
+        fprintf(fp, "Pf\n%d %d\n%s\n", window_width, window_height, is_little_endian() ? "-1.0" : "1.0");
+        for (int y = window_height - 1; y >= 0; y--) {
+                fwrite(&z_buffer[y * window_width], sizeof(float), window_width, fp);
+        }
+
+        bool ok = !ferror(fp);
+        if (fclose(fp) != 0) ok = false;
+        if (!ok) fprintf(stderr, "failed to write file %s\n", path);
+        return ok;
+}
+
+// read the pixels of a file written by write_color_buffer_ppm() or write_z_buffer_pfm(),
+// the size has to match the window
+static void *read_reference(const char *path, const char *magic, size_t pixel_size) {
+        FILE *fp = fopen(path, "rb");
+        if (!fp) {
+                fprintf(stderr, "failed to open file %s\n", path);
+                return NULL;
+        }
+
+        char format[3] = {0};
+        int width = 0;
+        int height = 0;
+        char scale[16] = {0};
+        void *pixels = NULL;
+        if (fscanf(fp, "%2s %d %d %15s", format, &width, &height, scale) == 4 && fgetc(fp) == '\n' &&
+            format[0] == magic[0] && format[1] == magic[1] && width == window_width && height == window_height) {
+                size_t size = (size_t)width * height * pixel_size;
+                pixels = malloc(size);
+                if (pixels && fread(pixels, 1, size, fp) != size) {
+                        free(pixels);
+                        pixels = NULL;
+                }
+        }
+        fclose(fp);
+
+        if (!pixels) fprintf(stderr, "%s is not a %dx%d %s file\n", path, window_width, window_height, magic);
+        return pixels;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ULL;
+        }
+        return hash;
+}
+
+// 64 bit FNV-1a of the rgb bytes of color_buffer and of the bits of z_buffer, row by row
+static golden_hash_t golden_hash(const char *name) {
+        golden_hash_t h;
+        snprintf(h.name, sizeof(h.name), "%s", name);
+        h.color = 0xCBF29CE484222325ULL;
+        h.depth = 0xCBF29CE484222325ULL;
+
+        int num_pixels = window_width * window_height;
+        for (int i = 0; i < num_pixels; i++) {
+                // red, green and blue, SDL_PIXELFORMAT_RGBA32 is a byte order
+                h.color = fnv1a(h.color, (const uint8_t *)&color_buffer[i], 3);
+
+                // the same bytes on any endianness
+                uint32_t bits;
+                memcpy(&bits, &z_buffer[i], sizeof(bits));
+                uint8_t bytes[4] = { bits & 0xFF, (bits >> 8) & 0xFF, (bits >> 16) & 0xFF, bits >> 24 };
+                h.depth = fnv1a(h.depth, bytes, sizeof(bytes));
+        }
+        return h;
+}
+
+// the hash of name in dir/hashes.txt, false when there is none
+static bool read_hash(const char *dir, const char *name, golden_hash_t *out) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, GOLDEN_HASHES);
+        FILE *fp = fopen(path, "r");
+        if (!fp) return false;
+
+        bool found = false;
+        char line[256];
+        while (!found && fgets(line, sizeof(line), fp)) {
+                char color[17], depth[17];
+                if (sscanf(line, "%63s %16s %16s", out->name, color, depth) != 3) continue;
+                if (strcmp(out->name, name) != 0) continue;
+                out->color = strtoull(color, NULL, 16);
+                out->depth = strtoull(depth, NULL, 16);
+                found = true;
+        }
+        fclose(fp);
+        return found;
+}
+
+bool golden_write(const char *dir, const char *name) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.ppm", dir, name);
+        if (!write_color_buffer_ppm(path)) return false;
+
+        snprintf(path, sizeof(path), "%s/%s.pfm", dir, name);
+        if (!write_z_buffer_pfm(path)) return false;
+
+        assert(num_written < MAX_GOLDEN_HASHES);
+        written[num_written++] = golden_hash(name);
+
+        printf("%s: written\n", name);
+        return true;
+}
+
+// dir/hashes.txt with one line per golden_write() so far: name, color hash, depth hash
+bool golden_save_hashes(const char *dir) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, GOLDEN_HASHES);
+        FILE *fp = fopen(path, "w");
+        if (!fp) {
+                fprintf(stderr, "failed to open file %s\n", path);
+                return false;
+        }
+
+        for (int i = 0; i < num_written; i++) {
+                fprintf(fp, "%s %016llx %016llx\n", written[i].name,
+                        (unsigned long long)written[i].color, (unsigned long long)written[i].depth);
+        }
+
+        bool ok = !ferror(fp);
+        if (fclose(fp) != 0) ok = false;
+        if (!ok) fprintf(stderr, "failed to write file %s\n", path);
+        return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// compare color_buffer and z_buffer with the reference of name and print one line
+// a matching hash in dir/hashes.txt passes right away, otherwise the images decide:
+//    name (variant): pixels whose color is off by more than color_tolerance in any channel,
+//    the largest channel difference, depth values off by more than depth_tolerance and the
+//    largest depth difference
+// returns true when no pixel is out of tolerance
+// only the hashes are committed, the images of a trusted build have to be written with
+// --golden-write first to get the per-pixel report and the tolerances
+/////////////////////////////////////////////////////////////////////////////////////////
+bool golden_check(const char *dir, const char *name, const char *variant, int color_tolerance, float depth_tolerance) {
+        golden_hash_t expected;
+        bool has_hash = read_hash(dir, name, &expected);
+        if (has_hash) {
+                golden_hash_t actual = golden_hash(name);
+                if (actual.color == expected.color && actual.depth == expected.depth) {
+                        printf("%s (%s): ok, identical\n", name, variant);
+                        return true;
+                }
+        }
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.ppm", dir, name);
+        uint8_t *colors = (uint8_t *)read_reference(path, "P6", 3);
+        snprintf(path, sizeof(path), "%s/%s.pfm", dir, name);
+        float *depths = (float *)read_reference(path, "Pf", sizeof(float));
+
+        if (!colors || !depths) {
+                printf("%s (%s): FAIL, %s\n", name, variant, has_hash ? "hash differs, no images for a per-pixel report" : "missing reference");
+                free(colors);
+                free(depths);
+                return false;
+        }
+
+        int num_pixels = window_width * window_height;
+        int color_errors = 0;
+        int max_color_diff = 0;
+        for (int i = 0; i < num_pixels; i++) {
+                // SDL_PIXELFORMAT_RGBA32 is a byte order, red is the first byte in memory
+                uint8_t *pixel = (uint8_t *)&color_buffer[i];
+                int diff = 0;
+                for (int c = 0; c < 3; c++) {
+                        int d = abs((int)pixel[c] - (int)colors[3 * i + c]);
+                        if (d > diff) diff = d;
+                }
+                if (diff > max_color_diff) max_color_diff = diff;
+                if (diff > color_tolerance) color_errors++;
+        }
+
+        int depth_errors = 0;
+        float max_depth_diff = 0;
+        for (int y = 0; y < window_height; y++) {
+                float *row = &depths[(window_height - 1 - y) * window_width];
+                for (int x = 0; x < window_width; x++) {
+                        float diff = fabsf(z_buffer[y * window_width + x] - row[x]);
+                        if (!(diff <= depth_tolerance)) depth_errors++; /* NaN counts as an error */
+                        if (diff > max_depth_diff) max_depth_diff = diff;
+                }
+        }
+
+        bool ok = color_errors == 0 && depth_errors == 0;
+        printf("%s (%s): %s, %d/%d colors off (max %d), %d/%d depths off (max %g)\n",
+               name, variant, ok ? "ok" : "FAIL",
+               color_errors, num_pixels, max_color_diff,
+               depth_errors, num_pixels, max_depth_diff);
+
+        free(colors);
+        free(depths);
+        return ok;
+}
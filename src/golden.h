@@ -0,0 +1,15 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+#include <stdbool.h>
+
+/*
+ * golden images
+ * color_buffer and z_buffer of a rendered scene are saved to dir/name.ppm and dir/name.pfm,
+ * later renders of the same scene are compared pixel by pixel against them
+ * dir/hashes.txt keeps a hash of both buffers per scene, it is small enough to be committed,
+ * see golden_check()
+ */
+bool golden_write(const char *dir, const char *name);
+bool golden_save_hashes(const char *dir);
+bool golden_check(const char *dir, const char *name, const char *variant, int color_tolerance, float depth_tolerance);
+#endif
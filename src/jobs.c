@@ -0,0 +1,140 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include "jobs.h"
+
+#define MAX_WORKERS 31
+
+// one jobs_run() call, lives on the stack of the caller
+typedef struct job_batch {
+        job_fn fn;
+        void *ctx;
+        int num_tasks;
+        int next_task;          // next task to hand out
+        int finished_tasks;     // tasks done so far
+        struct job_batch *next; // batches that still have tasks to hand out
+} job_batch;
+
+static SDL_Thread *workers[MAX_WORKERS];
+static int num_workers = 0;
+static SDL_mutex *lock = NULL;
+static SDL_cond *work_available = NULL;
+static SDL_cond *work_finished = NULL;
+static job_batch *pending = NULL;
+static bool quitting = false;
+
+/*
+ * hand out the next task of the oldest pending batch, must hold the lock
+ * a batch leaves the pending list as soon as its last task is handed out,
+ * so nobody looks at it after jobs_run() returned
+ */
+static job_batch *claim_task(job_batch *only, int *task) {
+        job_batch **link = &pending;
+        while (*link != NULL && only != NULL && *link != only) link = &(*link)->next;
+
+        job_batch *batch = *link;
+        if (batch == NULL) return NULL;
+
+        *task = batch->next_task++;
+        if (batch->next_task == batch->num_tasks) *link = batch->next;
+        return batch;
+}
+
+// run the task with the lock released, must hold the lock
+static void run_task(job_batch *batch, int task) {
+        SDL_UnlockMutex(lock);
+        batch->fn(batch->ctx, task);
+        SDL_LockMutex(lock);
+
+        batch->finished_tasks++;
+        if (batch->finished_tasks == batch->num_tasks) SDL_CondBroadcast(work_finished);
+}
+
+static int worker_main(void *data) {
+        (void)data;
+
+        SDL_LockMutex(lock);
+        while (true) {
+                while (!quitting && pending == NULL) SDL_CondWait(work_available, lock);
+                if (quitting) break;
+
+                int task;
+                job_batch *batch = claim_task(NULL, &task);
+                run_task(batch, task);
+        }
+        SDL_UnlockMutex(lock);
+        return 0;
+}
+
+void jobs_init(int n) {
+        if (n < 0) n = 0;
+        if (n > MAX_WORKERS) n = MAX_WORKERS;
+
+        lock = SDL_CreateMutex();
+        work_available = SDL_CreateCond();
+        work_finished = SDL_CreateCond();
+        quitting = false;
+
+        for (num_workers = 0; num_workers < n; num_workers++) {
+                workers[num_workers] = SDL_CreateThread(worker_main, "worker", NULL);
+                if (workers[num_workers] == NULL) {
+                        // not fatal, the calling thread can always do the work itself
+                        fprintf(stderr, "failed to create worker thread: %s\n", SDL_GetError());
+                        break;
+                }
+        }
+}
+
+void jobs_shutdown(void) {
+        SDL_LockMutex(lock);
+        quitting = true;
+        SDL_CondBroadcast(work_available);
+        SDL_UnlockMutex(lock);
+
+        for (int i = 0; i < num_workers; i++) SDL_WaitThread(workers[i], NULL);
+        num_workers = 0;
+
+        SDL_DestroyCond(work_finished);
+        SDL_DestroyCond(work_available);
+        SDL_DestroyMutex(lock);
+        lock = NULL;
+}
+
+// worker threads plus the calling thread
+int jobs_num_threads(void) {
+        return num_workers + 1;
+}
+
+void jobs_run(int num_tasks, job_fn fn, void *ctx) {
+        if (num_tasks <= 0) return;
+
+        // nothing to share, skip the locking
+        if (num_workers == 0 || num_tasks == 1) {
+                for (int i = 0; i < num_tasks; i++) fn(ctx, i);
+                return;
+        }
+
+        job_batch batch = {
+                .fn = fn,
+                .ctx = ctx,
+                .num_tasks = num_tasks,
+                .next_task = 0,
+                .finished_tasks = 0,
+                .next = NULL,
+        };
+
+        SDL_LockMutex(lock);
+        job_batch **tail = &pending;
+        while (*tail != NULL) tail = &(*tail)->next;
+        *tail = &batch;
+        SDL_CondBroadcast(work_available);
+
+        // help with our own batch instead of idling
+        int task;
+        while (batch.next_task < batch.num_tasks && claim_task(&batch, &task) != NULL) {
+                run_task(&batch, task);
+        }
+
+        while (batch.finished_tasks < batch.num_tasks) SDL_CondWait(work_finished, lock);
+        SDL_UnlockMutex(lock);
+}
@@ -0,0 +1,15 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+/*
+ * a tiny fork-join worker pool
+ * jobs_run() splits the work into num_tasks tasks, the calling thread helps out
+ * and the call returns once every task has finished
+ */
+typedef void (*job_fn)(void *ctx, int task);
+
+void jobs_init(int num_workers);
+void jobs_shutdown(void);
+int jobs_num_threads(void);
+void jobs_run(int num_tasks, job_fn fn, void *ctx);
+#endif
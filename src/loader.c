@@ -0,0 +1,175 @@
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "loader.h"
+
+#define MAX_LOADERS 8
+
+// one requested asset, on the request queue, being loaded, or on the completion queue
+typedef struct asset_job {
+        asset_t asset;
+        struct asset_job *next;
+} asset_job;
+
+static SDL_Thread *loaders[MAX_LOADERS];
+static int num_loaders = 0;
+static SDL_mutex *lock = NULL;
+static SDL_cond *request_available = NULL;
+static SDL_cond *asset_finished = NULL;
+static asset_job *requested = NULL; // oldest first
+static asset_job *finished = NULL;  // oldest first
+static int num_loading = 0;         // taken off the request queue, not finished yet
+static bool quitting = false;
+
+static void push_job(asset_job **list, asset_job *job) {
+        job->next = NULL;
+        while (*list != NULL) list = &(*list)->next;
+        *list = job;
+}
+
+static asset_job *pop_job(asset_job **list) {
+        asset_job *job = *list;
+        if (job != NULL) *list = job->next;
+        return job;
+}
+
+static void load_asset_job(asset_job *job) {
+        asset_t *a = &job->asset;
+        switch (a->kind) {
+        case ASSET_MESH:
+                a->failed = !load_obj_into(&a->mesh, a->path);
+                break;
+        case ASSET_TEXTURE:
+                a->failed = !load_png_texture_into(&a->texture, a->path);
+                break;
+        }
+}
+
+static void free_asset_jobs(asset_job **list) {
+        asset_job *job;
+        while ((job = pop_job(list)) != NULL) {
+                destroy_mesh(&job->asset.mesh);
+                free_texture(&job->asset.texture);
+                free(job);
+        }
+}
+
+static int loader_main(void *data) {
+        (void)data;
+
+        SDL_LockMutex(lock);
+        while (true) {
+                while (!quitting && requested == NULL) SDL_CondWait(request_available, lock);
+                if (quitting) break;
+
+                asset_job *job = pop_job(&requested);
+                num_loading++;
+                SDL_UnlockMutex(lock);
+
+                load_asset_job(job);
+
+                SDL_LockMutex(lock);
+                num_loading--;
+                push_job(&finished, job);
+                SDL_CondBroadcast(asset_finished);
+        }
+        SDL_UnlockMutex(lock);
+        return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// every loader thread takes one request at a time, so up to num_threads assets load at once
+// obj files are still parsed in parallel chunks on the job pool, see parse_obj()
+/////////////////////////////////////////////////////////////////////////////////////////
+void loader_init(int n) {
+        if (n < 0) n = 0;
+        if (n > MAX_LOADERS) n = MAX_LOADERS;
+
+        lock = SDL_CreateMutex();
+        request_available = SDL_CreateCond();
+        asset_finished = SDL_CreateCond();
+        quitting = false;
+
+        for (num_loaders = 0; num_loaders < n; num_loaders++) {
+                loaders[num_loaders] = SDL_CreateThread(loader_main, "loader", NULL);
+                if (loaders[num_loaders] == NULL) {
+                        // not fatal, loader_request() loads on the calling thread without any loader
+                        fprintf(stderr, "failed to create loader thread: %s\n", SDL_GetError());
+                        break;
+                }
+        }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// waits for the assets that are being loaded right now, the ones nobody picked up are freed
+// a load can't be interrupted, a big file delays the exit until it is done
+/////////////////////////////////////////////////////////////////////////////////////////
+void loader_shutdown(void) {
+        if (lock == NULL) return;
+
+        SDL_LockMutex(lock);
+        quitting = true;
+        SDL_CondBroadcast(request_available);
+        SDL_UnlockMutex(lock);
+
+        for (int i = 0; i < num_loaders; i++) SDL_WaitThread(loaders[i], NULL);
+        num_loaders = 0;
+
+        free_asset_jobs(&requested);
+        free_asset_jobs(&finished);
+
+        SDL_DestroyCond(asset_finished);
+        SDL_DestroyCond(request_available);
+        SDL_DestroyMutex(lock);
+        lock = NULL;
+}
+
+void loader_request(enum asset_kind kind, const char *path) {
+        assert(lock != NULL);
+
+        asset_job *job = (asset_job *)calloc(1, sizeof(asset_job));
+        assert(job != NULL);
+        job->asset.kind = kind;
+        snprintf(job->asset.path, sizeof(job->asset.path), "%s", path);
+
+        // no thread to hand it to, the asset is ready on the next loader_poll()
+        if (num_loaders == 0) {
+                load_asset_job(job);
+                SDL_LockMutex(lock);
+                push_job(&finished, job);
+                SDL_UnlockMutex(lock);
+                return;
+        }
+
+        SDL_LockMutex(lock);
+        push_job(&requested, job);
+        SDL_CondSignal(request_available);
+        SDL_UnlockMutex(lock);
+}
+
+// take the oldest finished asset off the completion queue, false when none is ready yet
+bool loader_poll(asset_t *asset) {
+        SDL_LockMutex(lock);
+        asset_job *job = pop_job(&finished);
+        SDL_UnlockMutex(lock);
+
+        if (job == NULL) return false;
+        *asset = job->asset;
+        free(job);
+        return true;
+}
+
+// like loader_poll(), but blocks until an asset is finished, false when nothing is left to load
+bool loader_wait(asset_t *asset) {
+        SDL_LockMutex(lock);
+        while (finished == NULL && (requested != NULL || num_loading > 0)) SDL_CondWait(asset_finished, lock);
+        asset_job *job = pop_job(&finished);
+        SDL_UnlockMutex(lock);
+
+        if (job == NULL) return false;
+        *asset = job->asset;
+        free(job);
+        return true;
+}
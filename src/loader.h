@@ -0,0 +1,33 @@
+#ifndef LOADER_H
+#define LOADER_H
+#include <stdbool.h>
+#include "mesh.h"
+#include "texture.h"
+
+/*
+ * background asset loading
+ * loader_request() queues a file and returns at once, loader threads parse or decode it
+ * into an asset_t of their own and put it on a completion queue, the main thread picks
+ * finished assets up with loader_poll() between frames and swaps them in, a file that
+ * couldn't be loaded comes back as failed with an empty mesh or texture
+ * the loader threads never touch the global mesh or texture
+ */
+enum asset_kind {
+        ASSET_MESH,    // obj file, see load_obj_into()
+        ASSET_TEXTURE, // png file, see load_png_texture_into()
+};
+
+typedef struct {
+        enum asset_kind kind;
+        char path[256];
+        bool failed;       // the error went to stderr, mesh and texture are empty
+        mesh_t mesh;       // ASSET_MESH
+        texture_t texture; // ASSET_TEXTURE
+} asset_t;
+
+void loader_init(int num_threads);
+void loader_shutdown(void);
+void loader_request(enum asset_kind kind, const char *path);
+bool loader_poll(asset_t *asset);
+bool loader_wait(asset_t *asset);
+#endif
@@ -1,6 +1,11 @@
 #include <stdint.h>
 #include <assert.h>
+#include <math.h>
+#include <string.h>
 #include "darray.h"
+#include "arena.h"
+#include "jobs.h"
+#include "loader.h"
 #include "clipping.h"
 #include "settings.h"
 #include "texture.h"
@@ -12,6 +17,10 @@
 #include "camera.h"
 #include "vector.h"
 #include "universe.h"
+#include "util.h"
+#include "prof.h"
+#include "golden.h"
+#include "upng.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////
 // render settings 
@@ -33,12 +42,70 @@ static enum render_method {
         RENDER_TEXTURED,
         RENDER_TEXTURED_WIRE,
 } render_method;
+
+static enum raster_method {
+        RASTER_SERIAL,
+        RASTER_TILED,
+} raster_method;
+
+static enum perspective_span perspective_span;
+static bool mipmapping;
+
+// render_method of the current frame, with a fallback for the assets that are still loading,
+// see placeholder_render_method()
+static enum render_method draw_method;
 /////////////////////////////////////////////////////////////////////////////////////////
 
 /////////////////////////////////////////////////////////////////////////////////////////
-// array of triangles that should be rendered frame by frame
+// per-frame geometry
+// everything below lives in frame_arena, it's allocated in update() and dropped at the end
+// of render(), see frame_arena_estimate() for the size reserved up front
 /////////////////////////////////////////////////////////////////////////////////////////
-static triangle_t *triangles_to_render = NULL;
+static arena_t frame_arena;
+
+// array of triangles that should be rendered frame by frame, ready for the rasterizer
+static raster_triangle_t *triangles_to_render = NULL;
+static raster_texcoords_t *texcoords_to_render = NULL; // the same triangles, NULL unless the render method is textured
+static int num_triangles_to_render = 0;
+
+// post-transform vertex cache, indexed like the mesh positions
+static vec4_t *view_vertices = NULL; // camera space
+static vec4_t *clip_vertices = NULL; // clip space (projection applied, before perspective divide)
+
+// split the per-frame work into fixed size chunks for the worker pool, see transform_job() and geometry_job()
+#define VERTICES_PER_JOB 1024
+#define FACES_PER_JOB 256
+
+// every chunk of faces owns a slice of the triangle array sized for TRIANGLES_PER_FACE
+// triangles per face, so the workers never have to grow anything, that holds every face of
+// the chunk with culling off and still leaves room for one extra triangle per face from the
+// clipper, a chunk that needs more than its slice is spilled, see spill_chunk(), instead of
+// reserving the worst case of MAX_CLIPPED_TRIANGLES per face
+// the clipper output gets MAX_CLIPPED_TRIANGLES more, so the last face always fits in there
+// and a chunk only spills when its triangles really don't fit
+#define TRIANGLES_PER_FACE 2
+#define TRIANGLES_PER_SLICE (FACES_PER_JOB * TRIANGLES_PER_FACE)
+#define CLIPPED_PER_SLICE (TRIANGLES_PER_SLICE + MAX_CLIPPED_TRIANGLES)
+static triangle_t *clipped_triangles = NULL; // clipper output of every chunk, CLIPPED_PER_SLICE each
+static int *chunk_counts = NULL;          // triangles written to each slice, -1 when it didn't fit
+static int num_spilled_chunks = 0;        // chunks of the last frame that didn't fit, see golden_check
+
+// clipper output and triangles of a spilled chunk, NULL for the chunks that fit into their slice
+typedef struct {
+        triangle_t *clipped;
+        raster_triangle_t *triangles;
+        raster_texcoords_t *texcoords;
+} chunk_spill_t;
+static chunk_spill_t *chunk_spills = NULL;
+static uint64_t (*chunk_ticks)[3] = NULL; // per-chunk time of culling, clipping and viewport mapping
+
+// screen tiles for the parallel rasterizer
+// the indices into triangles_to_render of tile t are tile_indices[tile_offsets[t]] up to tile_indices[tile_offsets[t + 1]]
+#define TILE_SIZE 64
+static int *tile_offsets = NULL;
+static int *tile_indices = NULL;
+static int tiles_x = 0;
+static int tiles_y = 0;
 
 /////////////////////////////////////////////////////////////////////////////////////////
 // global variables for execution status and game loop
@@ -48,10 +115,34 @@ static int previous_frame_time = 0;
 static mat4_t projection_matrix;
 static global_light light;
 static float delta_time = 0;
-static int fps = 0;
-static int previous_fps_time = 0;
 static bool paused = false;
 static bool mouse_down = false;
+static bool show_hud = true;
+static int frame_count = 0;
+
+// command line options
+static bool headless = false;          // render into color_buffer only, no window
+static int max_frames = 0;             // exit after this many frames, 0 runs until the window is closed
+static const char *dump_dir = NULL;    // write frames as ppm files into this directory
+static int dump_every = 0;             // dump every n-th frame, 0 dumps only the last one
+static const char *profile_path = NULL; // append per-frame stage timings to this csv file
+static const char *golden_dir = NULL;   // reference images of the golden scenes, see run_golden()
+static bool golden_writing = false;     // write the references instead of checking against them
+static int golden_color_tolerance = 0;
+static float golden_depth_tolerance = 0;
+static bool bench = false;             // headless benchmark over every asset and render method, see run_bench()
+static bool mesh_loading = false;      // the cube stands in until the loader has the mesh
+static bool texture_loading = false;   // textured methods fall back to flat shading until the loader has the texture
+
+// the golden scene render() has to save or check before clearing the buffers, NULL for none
+static const char *golden_name = NULL;
+static const char *golden_variant = NULL;
+static bool golden_passed = true;
+
+// per-frame counters of the benchmark
+static uint64_t bench_triangles = 0;
+static uint64_t bench_pixels = 0;
+static uint64_t bench_overhead = 0; // performance counter ticks spent counting, not part of the frame time
 
 static camera_t camera;
 // TODO(@k): we could have two fov, fov-x and fov-y, in that case, we need to modify orthographic matrix
@@ -59,6 +150,68 @@ static float fov = M_PI / 2;
 static float zn = 1.0; /* TODO(@k): if we want the near plane in NDC, we should set it 1, right? */
 static float zf = 300.0;
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// initial placement of the mesh and the camera, and the animation clock
+/////////////////////////////////////////////////////////////////////////////////////////
+static void reset_scene(void) {
+        mesh.rotation = (vec3_t){0, 0, 0};
+        mesh.scale = (vec3_t){1.3, 1.3, 1.3};
+        mesh.translation = (vec3_t){0, 0, 8}; // z index grows further inside the monitor, since we are using left-handed coordinate system
+
+        // camera
+        // NOTE(@k): this syntax is only valid in C99 standard and beyond
+        camera.position = (vec3_t){0, 0, 0};
+        camera.yaw = 0;
+        camera.pitch = 0;
+
+        frame_count = 0;
+        previous_frame_time = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// asset loading
+// one loader thread per asset of the scene, the mesh and its texture load at the same time
+// the loader threads hand finished assets over between frames, swapping them in never
+// races with the transform or raster jobs of a frame
+/////////////////////////////////////////////////////////////////////////////////////////
+#define LOADER_THREADS 2
+
+// a failed asset keeps what is shown now: the cube stays, a texture that never loaded
+// becomes the red bricks
+static void apply_asset(asset_t *asset) {
+        switch (asset->kind) {
+        case ASSET_MESH:
+                if (asset->failed) fprintf(stderr, "failed to load %s, keeping the current mesh\n", asset->path);
+                else replace_mesh(&asset->mesh);
+                mesh_loading = false;
+                break;
+        case ASSET_TEXTURE:
+                if (asset->failed) {
+                        fprintf(stderr, "failed to load %s, keeping the current texture\n", asset->path);
+                        if (num_mesh_mips == 0) load_redbrick_texture();
+                } else {
+                        replace_texture(&asset->texture);
+                }
+                texture_loading = false;
+                break;
+        }
+}
+
+static void apply_loaded_assets(void) {
+        if (!mesh_loading && !texture_loading) return;
+
+        asset_t asset;
+        while (loader_poll(&asset)) apply_asset(&asset);
+}
+
+// the wireframe of the placeholder cube while the mesh loads, flat shading while the texture loads
+static enum render_method placeholder_render_method(void) {
+        if (mesh_loading) return RENDER_WIRE;
+        if (texture_loading && render_method == RENDER_TEXTURED) return RENDER_FILL_TRIANGLE;
+        if (texture_loading && render_method == RENDER_TEXTURED_WIRE) return RENDER_FILL_TRIANGLE_WIRE;
+        return render_method;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // setup function to initialize variables and game objects
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -66,6 +219,12 @@ static void setup(void) {
         render_method = RENDER_FILL_TRIANGLE_WIRE;
         projection_method = PERSPECTIVE;
         cull_method = CULL_BACKFACE;
+        raster_method = RASTER_TILED;
+        perspective_span = PERSPECTIVE_EXACT;
+        mipmapping = true;
+
+        // one worker per extra core, the main thread works too
+        jobs_init(SDL_GetCPUCount() - 1);
 
         // allocate the required memory in bytes to hold the color buffer
         color_buffer = (uint32_t *)malloc(sizeof(uint32_t) * window_width * window_height);
@@ -73,10 +232,12 @@ static void setup(void) {
 
         // creating a SDL texture that is used to display the color buffer
         // SDL_TEXTUREACCESS_STREAMING for a fast write access
-        color_buffer_texture = SDL_CreateTexture(renderer,
-                                                 SDL_PIXELFORMAT_RGBA32,
-                                                 SDL_TEXTUREACCESS_STREAMING,
-                                                 window_width, window_height);
+        if (renderer) {
+                color_buffer_texture = SDL_CreateTexture(renderer,
+                                                         SDL_PIXELFORMAT_RGBA32,
+                                                         SDL_TEXTUREACCESS_STREAMING,
+                                                         window_width, window_height);
+        }
 
         // loads the cube values in the mesh data structure
 
@@ -92,15 +253,28 @@ static void setup(void) {
         // load_png_texture("./assets/drone.png");
         // load_obj("./assets/f117.obj");
         // load_png_texture("./assets/f117.png");
-        load_obj("./assets/crab.obj");
-        load_png_texture("./assets/crab.png");
+        // the benchmark and the golden scenes load every asset on their own
+        if (!bench && !golden_dir) {
+                // the first frame doesn't wait for the assets, the wireframe cube is shown until
+                // the mesh is ready, see apply_loaded_assets()
+                load_cube_mesh_data();
+                loader_init(LOADER_THREADS);
+                loader_request(ASSET_MESH, "./assets/crab.obj");
+                loader_request(ASSET_TEXTURE, "./assets/crab.png");
+                mesh_loading = true;
+                texture_loading = true;
+
+                // headless frames are compared and dumped, they must not depend on how
+                // fast the assets load
+                if (headless) {
+                        asset_t asset;
+                        while (loader_wait(&asset)) apply_asset(&asset);
+                }
+        }
         // load_obj("./assets/suzanne.obj");
 
-        // initial settings for mesh
-        mesh.scale.x = 1.3;
-        mesh.scale.y = 1.3;
-        mesh.scale.z = 1.3;
-        mesh.translation.z = 8; // z index grows further inside the monitor, since we are using left-handed coordinate system
+        // initial settings for mesh and camera
+        reset_scene();
 
         // create projection matrix (perspective projection or orthographic projection)
         // the NDC we will be using is the Vulkan's Canonical Viewing Volume
@@ -114,12 +288,6 @@ static void setup(void) {
         //           in the last step, we do depth division
         projection_matrix = projection_method == PERSPECTIVE ? mat4_make_perspective(fov, window_height, window_width, zn, zf) : mat4_make_orthographic(fov, window_height, window_width, zn, zf);
 
-        // camera
-        // NOTE(@k): this syntax is only valid in C99 standard and beyond
-        camera.position = (vec3_t){0, 0, 0};
-        camera.yaw = 0;
-        camera.pitch = 0;
-
         // global iluminacion
         light.direction = (vec3_t){0, 0, 1};
 }
@@ -165,6 +333,11 @@ static void process_input(void) {
                         // Pressing “b” toggle back-face culling
                         // Pressing "o" to switch to orthographic projection
                         // Pressing "p" to switch to perspective projection
+                        // Pressing "t" toggle tile-binned parallel rasterization
+                        // Pressing "c" cycle textured perspective correction: every pixel, every 8 pixels, every 16 pixels
+                        // Pressing "m" toggle mipmapping
+                        // Pressing "h" toggle the profiler hud
+                        // Pressing "r" start/stop writing per-frame stage timings to profile.csv
 
                         if (event.key.keysym.sym == SDLK_ESCAPE) is_running = false;
                         if (event.key.keysym.sym == SDLK_1) render_method = RENDER_WIRE_VERTEX;
@@ -208,83 +381,62 @@ static void process_input(void) {
                         // TODO(@k): it's kind hacky and kind unnecessary
                         if (event.key.keysym.sym == SDLK_b) cull_method = abs((int)cull_method - 1);
 
-                        break;
-                }
-        }
+                        // rasterize serially or per screen tile on the worker pool
+                        if (event.key.keysym.sym == SDLK_t) raster_method = raster_method == RASTER_TILED ? RASTER_SERIAL : RASTER_TILED;
 
-}
+                        // exact perspective divide per pixel or per span
+                        if (event.key.keysym.sym == SDLK_c) {
+                                if (perspective_span == PERSPECTIVE_EXACT) perspective_span = PERSPECTIVE_SPAN_8;
+                                else if (perspective_span == PERSPECTIVE_SPAN_8) perspective_span = PERSPECTIVE_SPAN_16;
+                                else perspective_span = PERSPECTIVE_EXACT;
+                        }
 
-/////////////////////////////////////////////////////////////////////////////////////////
-// update function frame by frame with a fixed time step
-// Model space => World space => Camera space => [Projection] => Clipping spcae => [Perspective divide] => Image space(NDC) => Screen space
-/////////////////////////////////////////////////////////////////////////////////////////
-static void update(void) {
-        if (paused) return;
+                        // sample the mip level of each triangle or always the full texture
+                        if (event.key.keysym.sym == SDLK_m) mipmapping = !mipmapping;
 
-        // NOTE(@k): lock fps if we want to
-        // wait some time until the reach the target frame time in milliseconds
-        // int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
-
-        // only delay execution if we are running too fast
-        // if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
-        //         SDL_Delay(time_to_wait);
-        // }
+                        // profiler
+                        if (event.key.keysym.sym == SDLK_h) show_hud = !show_hud;
+                        if (event.key.keysym.sym == SDLK_r) {
+                                if (prof_csv_is_open()) prof_csv_close();
+                                else prof_csv_open("./profile.csv");
+                        }
 
-        delta_time = (SDL_GetTicks() - previous_frame_time) / 1000.0;
-        if ((SDL_GetTicks() - previous_fps_time) > 100.0) {
-                fps = 1 / delta_time;
-                previous_fps_time = SDL_GetTicks();
+                        break;
+                }
         }
-        previous_frame_time = SDL_GetTicks();
-
-        // rotate frame by frame, aka animation
-        // mesh.rotation.x += 1 * delta_time;
-        mesh.rotation.y += 1 * delta_time;
-        // mesh.rotation.z += 1 * delta_time;
-
-        // camera.position.x += 1 * delta_time;
-        // camera.position.y += 1 * delta_time;
 
-        // create the transform (rotation, scale, translate) matrix
-        mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.z);
-        mat4_t translate_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
-        mat4_t rotation_x_matrix = mat4_make_rotation_x(mesh.rotation.x);
-        mat4_t rotation_y_matrix = mat4_make_rotation_y(mesh.rotation.y);
-        mat4_t rotation_z_matrix = mat4_make_rotation_z(mesh.rotation.z);
+}
 
-        vec3_t up = { 0, 1, 0 };
-        mat4_t view_matrix = mat4_look_at(mesh.translation, camera.position, up);
-        // mat4_t view_matrix = mat4_from_camera(camera.position, camera.yaw, camera.pitch);
+// a face that survived back-face culling, with its flat shaded color
+typedef struct {
+        int face;
+        uint32_t color;
+} visible_face_t;
 
-        // face -> triangle
-        for (int i = 0; i < darray_size(mesh.faces); i++) {
-                face_t mesh_face = mesh.faces[i];
+/////////////////////////////////////////////////////////////////////////////////////////
+// geometry stage for the faces [begin, end): back-face culling, flat shading, clipping,
+// viewport mapping and the raster setup, the resulting triangles are written to out and
+// uv_out in face order and their number is returned, uv_out is NULL for untextured render methods
+// out and uv_out have room for capacity triangles, clip_out for MAX_CLIPPED_TRIANGLES more,
+// -1 is returned when the triangles don't fit, capacity FACES_PER_JOB * MAX_CLIPPED_TRIANGLES always fits
+// every step runs over the whole range before the next one starts, so each step can be
+// timed once per range, the times are added to ticks in that order
+// only reads shared state, so disjoint face ranges can run on different threads
+/////////////////////////////////////////////////////////////////////////////////////////
+static int process_faces(int begin, int end, triangle_t *clip_out, raster_triangle_t *out, raster_texcoords_t *uv_out, int capacity, uint64_t ticks[3]) {
+        assert(end - begin <= FACES_PER_JOB);
+        visible_face_t visible[FACES_PER_JOB];
+        int num_visible = 0;
 
-                // 3 vertices per face
-                vec3_t face_vertices[3];
-                face_vertices[0] = mesh.vertices[mesh_face.a - 1];
-                face_vertices[1] = mesh.vertices[mesh_face.b - 1];
-                face_vertices[2] = mesh.vertices[mesh_face.c - 1];
+        uint64_t start = prof_now();
 
+        // back-face culling and flat shading
+        for (int i = begin; i < end; i++) {
+                // 3 vertices per face, already transformed into camera space
                 vec4_t transformed_vertices[3];
-
-                // process every vertices in the face
-                // transform (rotation, scale, translate)
-                for (int j = 0; j < 3; j++) {
-                        vec4_t v = vec4_from_vec3(face_vertices[j], 1.0);
-
-                        // scale, rotate, then translate, the order here matters
-                        mat4_t world_matrix = mat4_eye();
-                        world_matrix = mat4_mul_mat4(scale_matrix, world_matrix);
-                        world_matrix = mat4_mul_mat4(rotation_x_matrix, world_matrix);
-                        world_matrix = mat4_mul_mat4(rotation_y_matrix, world_matrix);
-                        world_matrix = mat4_mul_mat4(rotation_z_matrix, world_matrix);
-                        world_matrix = mat4_mul_mat4(translate_matrix, world_matrix);
-                        world_matrix = mat4_mul_mat4(view_matrix, world_matrix);
-
-                        v = mat4_mul_vec4(world_matrix, v);
-                        transformed_vertices[j] = v;
-                }
+                transformed_vertices[0] = view_vertices[mesh_vertex_index(&mesh, i, 0)];
+                transformed_vertices[1] = view_vertices[mesh_vertex_index(&mesh, i, 1)];
+                transformed_vertices[2] = view_vertices[mesh_vertex_index(&mesh, i, 2)];
 
                 // get face_normal
                 vec3_t v_a = vec3_from_vec4(transformed_vertices[0]);
@@ -314,17 +466,28 @@ static void update(void) {
                         if (alignment <= 0) continue; /* skip the current face */
                 }
 
-                triangle_t triangle = {
-                        .points = {},
-                        .texcoords = { mesh_face.a_uv, mesh_face.b_uv, mesh_face.c_uv },
-                        .color = mesh_face.color,
-                };
+                // handle light [-1, 1] => [0, 1]
+                // TODO(@k): we may later try smooth shading, it's a per pixel processing (some kind of linear interpolation) (ground shading algorithm, phong reflection model)
+                // flat shading (easy and fast)
+                float alignment = vec3_dot(vec3_inverse(light.direction), face_normal);
+                float intensity = 0.5 * alignment + 0.5; /* it's better to do linear interp here, instead of clamping */
+                uint32_t face_color = light_apply_intensity(mesh.color, intensity);
 
-                // loop all three vertices in the face to perform projection
-                for (int j = 0; j < 3; j++) {
-                        // project 3d vertices to 2d point
-                        vec4_t p = mat4_mul_vec4(projection_matrix, transformed_vertices[j]);
-                        triangle.points[j] = p;
+                visible[num_visible++] = (visible_face_t){ .face = i, .color = face_color };
+        }
+
+        uint64_t culled = prof_now();
+
+        // frustum clipping
+        int count = 0;
+        for (int v = 0; v < num_visible; v++) {
+                int f = visible[v].face;
+                triangle_t triangle = { .color = visible[v].color };
+
+                // projected points come straight from the clip space cache, uvs from the shared array
+                for (int k = 0; k < 3; k++) {
+                        triangle.points[k] = clip_vertices[mesh_vertex_index(&mesh, f, k)];
+                        triangle.texcoords[k] = mesh.uvs[mesh_uv_index(&mesh, f, k)];
                 }
 
                 // frustum culling
@@ -345,67 +508,307 @@ static void update(void) {
                 // }
                 // if (!is_triangle_in_frustum) continue; // skip current face, since the whole face is outside the frustum
 
-                // handle light [-1, 1] => [0, 1]
-                // TODO(@k): we may later try smooth shading, it's a per pixel processing (some kind of linear interpolation) (ground shading algorithm, phong reflection model)
-                // flat shading (easy and fast)
-                float alignment = vec3_dot(vec3_inverse(light.direction), face_normal);
-                float intensity = 0.5 * alignment + 0.5; /* it's better to do linear interp here, instead of clamping */
-                uint32_t face_color = light_apply_intensity(mesh_face.color, intensity); 
-
-                // frustum clipping
                 // TODO(@k): handle orthographic projection issue
-                triangle_t clipped_triangles[MAX_CLIPPED_TRIANGLES] = {};
-                int num_clipped_triangles = clip_triangle(&triangle, zn, zf, clipped_triangles);
-
                 // NOTE(@k): after clipping, we could end up more than one triangles
-                for (int i = 0; i < num_clipped_triangles; i++) {
-                        triangle_t *t = &clipped_triangles[i] ;
-                        t->color = face_color;
-
-                        // projection division
-                        for (int i = 0; i < 3; i++) {
-                                assert(t->points[i].w != 0.0);
-                                t->points[i].x /= t->points[i].w;
-                                t->points[i].y /= t->points[i].w;
-                                t->points[i].z /= t->points[i].w;
-
-                                // clipping space to screen space
-                                // // translate based on window position
-                                // // screen
-                                // // [X X X X X X X]
-                                // // [X X X X X X X]
-                                // // [X X X O X X X] origin is in the center
-                                // // [X X X X X X X]
-                                // // [X X X X X X X]
-                                float half_ww = window_width / 2.0;
-                                float half_wh = window_height / 2.0;
-
-                                // scale, and translate the projected points to the middle of the screen
-                                // TODO(@k): not 100% sure if we need to multiply (1/zn) here
-                                t->points[i].x = t->points[i].x * half_ww * (1 / zn) + half_ww;
-                                // NOTE(@k): y grow towards downside in the screen coordinate system, so we negate y here
-                                t->points[i].y = (-t->points[i].y) * half_wh * (1 / zn) + half_wh;
-
-                                // NOTE(@k): handle precesion issue
-                                float allow_margin = -0.01;
-                                if (t->points[i].x < 0.0) {
-                                        assert(t->points[i].x > allow_margin);
-                                        t->points[i].x = 0.0;
-                                }
-
-                                if (t->points[i].y < 0.0) {
-                                        assert(t->points[i].y > allow_margin);
-                                        t->points[i].y = 0.0;
-                                }
+                count += clip_triangle(&triangle, zn, zf, &clip_out[count]);
+                if (count > capacity) return -1;
+        }
+
+        uint64_t clipped = prof_now();
+
+        // the level of detail is only needed for textures
+        const mip_level_t *mips = uv_out ? mesh_mips : NULL;
+        int num_mips = mipmapping ? num_mesh_mips : 1;
+
+        // perspective divide, viewport mapping and raster setup
+        for (int k = 0; k < count; k++) {
+                triangle_t *t = &clip_out[k];
+
+                // projection division
+                for (int i = 0; i < 3; i++) {
+                        assert(t->points[i].w != 0.0);
+                        t->points[i].x /= t->points[i].w;
+                        t->points[i].y /= t->points[i].w;
+                        t->points[i].z /= t->points[i].w;
+
+                        // clipping space to screen space
+                        // // translate based on window position
+                        // // screen
+                        // // [X X X X X X X]
+                        // // [X X X X X X X]
+                        // // [X X X O X X X] origin is in the center
+                        // // [X X X X X X X]
+                        // // [X X X X X X X]
+                        float half_ww = window_width / 2.0;
+                        float half_wh = window_height / 2.0;
+
+                        // scale, and translate the projected points to the middle of the screen
+                        // TODO(@k): not 100% sure if we need to multiply (1/zn) here
+                        t->points[i].x = t->points[i].x * half_ww * (1 / zn) + half_ww;
+                        // NOTE(@k): y grow towards downside in the screen coordinate system, so we negate y here
+                        t->points[i].y = (-t->points[i].y) * half_wh * (1 / zn) + half_wh;
+
+                        // NOTE(@k): handle precesion issue
+                        float allow_margin = -0.01;
+                        if (t->points[i].x < 0.0) {
+                                assert(t->points[i].x > allow_margin);
+                                t->points[i].x = 0.0;
                         }
 
-                        // calculate the average depth for each face based on the vertices after transformation
-                        // NOTE(@k): this is a naive approach, better off to use z-buffer
-                        // float avg_depth = (projected_points[0].z + projected_points[1].z + projected_points[2].z) / 3.0;
+                        if (t->points[i].y < 0.0) {
+                                assert(t->points[i].y > allow_margin);
+                                t->points[i].y = 0.0;
+                        }
+                }
+
+                // calculate the average depth for each face based on the vertices after transformation
+                // NOTE(@k): this is a naive approach, better off to use z-buffer
+                // float avg_depth = (projected_points[0].z + projected_points[1].z + projected_points[2].z) / 3.0;
+
+                // fixed point positions, reciprocals and the mip level are computed once
+                // here, not again for every tile the triangle touches
+                raster_triangle_setup(t, mips, num_mips, &out[k], uv_out ? &uv_out[k] : NULL);
+        }
+
+        uint64_t mapped = prof_now();
+        ticks[0] += culled - start;
+        ticks[1] += clipped - culled;
+        ticks[2] += mapped - clipped;
+        return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// split the per-frame work into fixed size chunks for the worker pool
+// chunk boundaries don't depend on the number of threads and every chunk writes
+// its own list, so the concatenated result is the same as a single threaded run
+/////////////////////////////////////////////////////////////////////////////////////////
+static void transform_job(void *ctx, int chunk) {
+        mat4_t *matrices = (mat4_t *)ctx; /* model-view, model-view-projection */
+        int begin = chunk * VERTICES_PER_JOB;
+        int count = MIN(VERTICES_PER_JOB, mesh.num_vertices - begin);
+        const float *x = mesh.x + begin;
+        const float *y = mesh.y + begin;
+        const float *z = mesh.z + begin;
+
+        // camera space is still needed for back-face culling and flat shading
+        mat4_mul_vec4_batch(&matrices[0], x, y, z, view_vertices + begin, count);
+        mat4_mul_vec4_batch(&matrices[1], x, y, z, clip_vertices + begin, count);
+}
+
+static void geometry_job(void *ctx, int chunk) {
+        (void)ctx;
+        int begin = chunk * FACES_PER_JOB;
+        int end = MIN(begin + FACES_PER_JOB, mesh.num_faces);
+
+        chunk_ticks[chunk][0] = chunk_ticks[chunk][1] = chunk_ticks[chunk][2] = 0;
+        int slice = chunk * TRIANGLES_PER_SLICE;
+        raster_texcoords_t *uv = texcoords_to_render ? &texcoords_to_render[slice] : NULL;
+        triangle_t *clip_out = &clipped_triangles[chunk * CLIPPED_PER_SLICE];
+        chunk_counts[chunk] = process_faces(begin, end, clip_out, &triangles_to_render[slice], uv, TRIANGLES_PER_SLICE, chunk_ticks[chunk]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// give a chunk that didn't fit into its slice arrays of its own for the worst case, on the
+// main thread since the arena isn't shared, the arena grows for them and keeps the size
+// from the next frame on, spill_job() then runs the chunk again
+/////////////////////////////////////////////////////////////////////////////////////////
+#define TRIANGLES_PER_SPILL (FACES_PER_JOB * MAX_CLIPPED_TRIANGLES)
+
+static void spill_chunk(int chunk) {
+        chunk_spill_t *spill = &chunk_spills[chunk];
+        spill->clipped = (triangle_t *)arena_alloc(&frame_arena, sizeof(triangle_t) * (TRIANGLES_PER_SPILL + MAX_CLIPPED_TRIANGLES));
+        spill->triangles = (raster_triangle_t *)arena_alloc(&frame_arena, sizeof(raster_triangle_t) * TRIANGLES_PER_SPILL);
+        spill->texcoords = NULL;
+        if (texcoords_to_render) {
+                spill->texcoords = (raster_texcoords_t *)arena_alloc(&frame_arena, sizeof(raster_texcoords_t) * TRIANGLES_PER_SPILL);
+        }
+}
+
+static void spill_job(void *ctx, int job) {
+        int chunk = ((const int *)ctx)[job]; /* indices of the spilled chunks */
+        int begin = chunk * FACES_PER_JOB;
+        int end = MIN(begin + FACES_PER_JOB, mesh.num_faces);
+
+        chunk_spill_t *spill = &chunk_spills[chunk];
+        chunk_ticks[chunk][0] = chunk_ticks[chunk][1] = chunk_ticks[chunk][2] = 0;
+        chunk_counts[chunk] = process_faces(begin, end, spill->clipped, spill->triangles, spill->texcoords, TRIANGLES_PER_SPILL, chunk_ticks[chunk]);
+        assert(chunk_counts[chunk] >= 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// transform every unique vertex of the mesh once per frame
+// faces share vertices, so the face loop only indexes into the cached results
+/////////////////////////////////////////////////////////////////////////////////////////
+static void transform_vertices(mat4_t *model_view_matrix, mat4_t *mvp_matrix) {
+        int num_vertices = mesh.num_vertices;
+        view_vertices = (vec4_t *)arena_alloc(&frame_arena, sizeof(vec4_t) * num_vertices);
+        clip_vertices = (vec4_t *)arena_alloc(&frame_arena, sizeof(vec4_t) * num_vertices);
+
+        mat4_t matrices[2] = { *model_view_matrix, *mvp_matrix };
+        jobs_run((num_vertices + VERTICES_PER_JOB - 1) / VERTICES_PER_JOB, transform_job, matrices);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// bytes of frame_arena one frame is expected to need: vertex caches, the triangle slices of
+// every chunk, and the tile bins assuming a triangle touches 4 tiles on average
+// spilled chunks and bins that need more grow the arena once, it then keeps the size
+/////////////////////////////////////////////////////////////////////////////////////////
+static size_t frame_arena_estimate(void) {
+        size_t num_vertices = mesh.num_vertices;
+        size_t num_faces = mesh.num_faces;
+        size_t num_chunks = (num_faces + FACES_PER_JOB - 1) / FACES_PER_JOB;
+        size_t num_tiles = (size_t)((window_width + TILE_SIZE - 1) / TILE_SIZE) * ((window_height + TILE_SIZE - 1) / TILE_SIZE);
+
+        size_t size = 0;
+        size += sizeof(vec4_t) * num_vertices * 2;
+        size += sizeof(triangle_t) * CLIPPED_PER_SLICE * num_chunks;
+        size += (sizeof(raster_triangle_t) + sizeof(raster_texcoords_t)) * TRIANGLES_PER_SLICE * num_chunks;
+        size += (sizeof(int) + sizeof(*chunk_ticks) + sizeof(chunk_spill_t)) * num_chunks;
+        size += sizeof(int) * (num_tiles + 1) * 2;
+        size += sizeof(int) * 4 * num_faces * 2; // tile range and bin entries
+        return size + 16 * ARENA_ALIGNMENT;      // padding of the allocations
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// milliseconds since start
+// headless runs step a simulated clock by one frame target time per frame, so the
+// animation and the dumped frames don't depend on how fast the machine is
+/////////////////////////////////////////////////////////////////////////////////////////
+static uint32_t get_ticks(void) {
+        if (headless) return (uint32_t)((int64_t)(frame_count + 1) * 1000 / FPS);
+        return SDL_GetTicks();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// update function frame by frame with a fixed time step
+// Model space => World space => Camera space => [Projection] => Clipping spcae => [Perspective divide] => Image space(NDC) => Screen space
+/////////////////////////////////////////////////////////////////////////////////////////
+static void update(void) {
+        draw_method = placeholder_render_method();
+        if (paused) return;
+
+        // NOTE(@k): lock fps if we want to
+        // wait some time until the reach the target frame time in milliseconds
+        // int time_to_wait = FRAME_TARGET_TIME - (SDL_GetTicks() - previous_frame_time);
+
+        // only delay execution if we are running too fast
+        // if (time_to_wait > 0 && time_to_wait <= FRAME_TARGET_TIME) {
+        //         SDL_Delay(time_to_wait);
+        // }
+
+        // headless frames advance by exactly one frame target time
+        uint32_t ticks = get_ticks();
+        delta_time = headless ? 1.0 / FPS : (ticks - previous_frame_time) / 1000.0;
+        previous_frame_time = ticks;
+
+        // rotate frame by frame, aka animation
+        // mesh.rotation.x += 1 * delta_time;
+        mesh.rotation.y += 1 * delta_time;
+        // mesh.rotation.z += 1 * delta_time;
+
+        // camera.position.x += 1 * delta_time;
+        // camera.position.y += 1 * delta_time;
+
+        // create the transform (rotation, scale, translate) matrix
+        mat4_t scale_matrix = mat4_make_scale(mesh.scale.x, mesh.scale.y, mesh.scale.z);
+        mat4_t translate_matrix = mat4_make_translation(mesh.translation.x, mesh.translation.y, mesh.translation.z);
+        mat4_t rotation_x_matrix = mat4_make_rotation_x(mesh.rotation.x);
+        mat4_t rotation_y_matrix = mat4_make_rotation_y(mesh.rotation.y);
+        mat4_t rotation_z_matrix = mat4_make_rotation_z(mesh.rotation.z);
+
+        vec3_t up = { 0, 1, 0 };
+        mat4_t view_matrix = mat4_look_at(mesh.translation, camera.position, up);
+        // mat4_t view_matrix = mat4_from_camera(camera.position, camera.yaw, camera.pitch);
 
-                        darray_push(triangles_to_render, *t);
+        // scale, rotate, then translate, the order here matters
+        // the matrices are the same for every vertex of the mesh, build them once per frame
+        mat4_t world_matrix = scale_matrix;
+        world_matrix = mat4_mul_mat4(rotation_x_matrix, world_matrix);
+        world_matrix = mat4_mul_mat4(rotation_y_matrix, world_matrix);
+        world_matrix = mat4_mul_mat4(rotation_z_matrix, world_matrix);
+        world_matrix = mat4_mul_mat4(translate_matrix, world_matrix);
+
+        mat4_t model_view_matrix = mat4_mul_mat4(view_matrix, world_matrix);
+        mat4_t mvp_matrix = mat4_mul_mat4(projection_matrix, model_view_matrix);
+
+        // per-frame geometry from here on comes from the arena
+        arena_reserve(&frame_arena, frame_arena_estimate());
+
+        // transform every unique vertex once, faces index into the cache below
+        uint64_t start = prof_now();
+        transform_vertices(&model_view_matrix, &mvp_matrix);
+        prof_add(PROF_TRANSFORM, prof_now() - start);
+
+        // face -> triangle, chunks of faces are processed in parallel
+        int num_faces = mesh.num_faces;
+        int num_chunks = (num_faces + FACES_PER_JOB - 1) / FACES_PER_JOB;
+        clipped_triangles = (triangle_t *)arena_alloc(&frame_arena, sizeof(triangle_t) * CLIPPED_PER_SLICE * num_chunks);
+        triangles_to_render = (raster_triangle_t *)arena_alloc(&frame_arena, sizeof(raster_triangle_t) * TRIANGLES_PER_SLICE * num_chunks);
+        texcoords_to_render = NULL;
+        if (draw_method == RENDER_TEXTURED || draw_method == RENDER_TEXTURED_WIRE) {
+                texcoords_to_render = (raster_texcoords_t *)arena_alloc(&frame_arena, sizeof(raster_texcoords_t) * TRIANGLES_PER_SLICE * num_chunks);
+        }
+        chunk_counts = (int *)arena_alloc(&frame_arena, sizeof(int) * num_chunks);
+        chunk_ticks = (uint64_t (*)[3])arena_alloc(&frame_arena, sizeof(*chunk_ticks) * num_chunks);
+        chunk_spills = (chunk_spill_t *)arena_alloc(&frame_arena, sizeof(chunk_spill_t) * num_chunks);
+        memset(chunk_spills, 0, sizeof(chunk_spill_t) * num_chunks);
+        start = prof_now();
+        jobs_run(num_chunks, geometry_job, NULL);
+
+        // chunks that didn't fit run again in parallel with arrays of their own
+        int num_spilled = 0;
+        int *spilled = NULL;
+        for (int i = 0; i < num_chunks; i++) {
+                if (chunk_counts[i] >= 0) continue;
+                if (!spilled) spilled = (int *)arena_alloc(&frame_arena, sizeof(int) * num_chunks);
+                spill_chunk(i);
+                spilled[num_spilled++] = i;
+        }
+        if (num_spilled > 0) jobs_run(num_spilled, spill_job, spilled);
+        num_spilled_chunks = num_spilled;
+        uint64_t geometry_ticks = prof_now() - start;
+
+        // the chunks run in parallel, their summed times are more than the time the
+        // frame waited, the wait is split between the steps by their share of the work
+        uint64_t step_ticks[3] = { 0, 0, 0 };
+        for (int i = 0; i < num_chunks; i++) {
+                for (int j = 0; j < 3; j++) step_ticks[j] += chunk_ticks[i][j];
+        }
+        uint64_t work_ticks = step_ticks[0] + step_ticks[1] + step_ticks[2];
+        if (work_ticks > 0) {
+                prof_add(PROF_CULL, (uint64_t)((double)geometry_ticks * step_ticks[0] / work_ticks));
+                prof_add(PROF_CLIP, (uint64_t)((double)geometry_ticks * step_ticks[1] / work_ticks));
+                prof_add(PROF_VIEWPORT, (uint64_t)((double)geometry_ticks * step_ticks[2] / work_ticks));
+        }
+
+        // close the gaps between the slices, the triangles stay in face order
+        // a spilled chunk may have more triangles than its slice holds, moving it in place could
+        // overwrite the slices after it, so with spills every chunk is copied into new arrays
+        raster_triangle_t *triangles = triangles_to_render;
+        raster_texcoords_t *texcoords = texcoords_to_render;
+        if (num_spilled > 0) {
+                int total = 0;
+                for (int i = 0; i < num_chunks; i++) total += chunk_counts[i];
+                triangles = (raster_triangle_t *)arena_alloc(&frame_arena, sizeof(raster_triangle_t) * total);
+                if (texcoords) texcoords = (raster_texcoords_t *)arena_alloc(&frame_arena, sizeof(raster_texcoords_t) * total);
+        }
+
+        num_triangles_to_render = 0;
+        for (int i = 0; i < num_chunks; i++) {
+                int slice = i * TRIANGLES_PER_SLICE;
+                const chunk_spill_t *spill = &chunk_spills[i];
+                const raster_triangle_t *src = spill->triangles ? spill->triangles : &triangles_to_render[slice];
+                if (src != &triangles[num_triangles_to_render]) {
+                        memmove(&triangles[num_triangles_to_render], src, sizeof(raster_triangle_t) * chunk_counts[i]);
+                        if (texcoords) {
+                                const raster_texcoords_t *src_uv = spill->triangles ? spill->texcoords : &texcoords_to_render[slice];
+                                memmove(&texcoords[num_triangles_to_render], src_uv, sizeof(raster_texcoords_t) * chunk_counts[i]);
+                        }
                 }
+                num_triangles_to_render += chunk_counts[i];
         }
+        triangles_to_render = triangles;
+        texcoords_to_render = texcoords;
 
         // NOTE(@k): this is an naive implementation to render base on the depth, z-buffer is better 
         // TODO(@k): bubble sort will do the job for now, but it could be a performance hit if we have much more triangle to render, consider quick-sort/merge-sort later
@@ -424,102 +827,571 @@ static void update(void) {
         // }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// draw triangle i of triangles_to_render with the current render method
+// only pixels inside clip are touched, NULL means the whole window
+/////////////////////////////////////////////////////////////////////////////////////////
+static void draw_render_triangle(int i, const rect_t *clip) {
+        const raster_triangle_t *triangle = &triangles_to_render[i];
+
+        // draw filled triangle
+        if (draw_method == RENDER_FILL_TRIANGLE || draw_method == RENDER_FILL_TRIANGLE_WIRE) {
+                draw_filled_triangle_v2(triangle, z_buffer, clip);
+        }
+
+        // draw textured triangle
+        if (draw_method == RENDER_TEXTURED || draw_method == RENDER_TEXTURED_WIRE) {
+                draw_textured_triangle(
+                        triangle, &texcoords_to_render[i],
+                        z_buffer, mesh_mips,
+                        perspective_span,
+                        clip
+                );
+        }
+
+        // whole pixels of the vertices for lines and rects
+        int x[3], y[3];
+        for (int j = 0; j < 3; j++) {
+                x[j] = triangle->x[j] >> SUBPIXEL_BITS;
+                y[j] = triangle->y[j] >> SUBPIXEL_BITS;
+        }
+
+        // draw triangle wireframe
+        if (draw_method == RENDER_WIRE || draw_method == RENDER_WIRE_VERTEX || draw_method == RENDER_TEXTURED_WIRE) {
+                draw_triangle(x[0], y[0], x[1], y[1], x[2], y[2], triangle->color, clip);
+        }
+
+        // draw triangle vertex points
+        if (draw_method == RENDER_WIRE_VERTEX) {
+                for (int j = 0; j < 3; j++) {
+                        draw_rect(x[j] - 1, y[j] - 1, 6, 6, 0xFFFFFFFF, clip);
+                }
+        }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// tile binning
+// every tile keeps the indices of the triangles that may touch it, in submission order,
+// so tiles can be rasterized independently and still match the serial output exactly
+/////////////////////////////////////////////////////////////////////////////////////////
+static void bin_triangles(void) {
+        tiles_x = (window_width + TILE_SIZE - 1) / TILE_SIZE;
+        tiles_y = (window_height + TILE_SIZE - 1) / TILE_SIZE;
+        int num_tiles = tiles_x * tiles_y;
+
+        // tiles touched by every triangle, counted per tile one slot ahead
+        int (*ranges)[4] = (int (*)[4])arena_alloc(&frame_arena, sizeof(*ranges) * num_triangles_to_render);
+        tile_offsets = (int *)arena_alloc(&frame_arena, sizeof(int) * (num_tiles + 1));
+        memset(tile_offsets, 0, sizeof(int) * (num_tiles + 1));
+
+        // vertex points are drawn as 6x6 rects starting one pixel up-left of the vertex,
+        // wireframe lines can be off by one pixel after rounding
+        int margin_lo = 2;
+        int margin_hi = draw_method == RENDER_WIRE_VERTEX ? 6 : 2;
+
+        for (int i = 0; i < num_triangles_to_render; i++) {
+                raster_triangle_t *t = &triangles_to_render[i];
+                int x_min = (MIN(MIN(t->x[0], t->x[1]), t->x[2]) >> SUBPIXEL_BITS) - margin_lo;
+                int y_min = (MIN(MIN(t->y[0], t->y[1]), t->y[2]) >> SUBPIXEL_BITS) - margin_lo;
+                int x_max = ((MAX(MAX(t->x[0], t->x[1]), t->x[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS) + margin_hi;
+                int y_max = ((MAX(MAX(t->y[0], t->y[1]), t->y[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS) + margin_hi;
+
+                int *r = ranges[i];
+                r[0] = MAX(x_min, 0) / TILE_SIZE;
+                r[1] = MAX(y_min, 0) / TILE_SIZE;
+                r[2] = MIN(MIN(x_max, window_width - 1) / TILE_SIZE, tiles_x - 1);
+                r[3] = MIN(MIN(y_max, window_height - 1) / TILE_SIZE, tiles_y - 1);
+
+                for (int ty = r[1]; ty <= r[3]; ty++) {
+                        for (int tx = r[0]; tx <= r[2]; tx++) tile_offsets[ty * tiles_x + tx + 1]++;
+                }
+        }
+
+        // counts to offsets, then fill every tile in submission order
+        for (int t = 0; t < num_tiles; t++) tile_offsets[t + 1] += tile_offsets[t];
+        tile_indices = (int *)arena_alloc(&frame_arena, sizeof(int) * tile_offsets[num_tiles]);
+        int *cursor = (int *)arena_alloc(&frame_arena, sizeof(int) * num_tiles);
+        memcpy(cursor, tile_offsets, sizeof(int) * num_tiles);
+
+        for (int i = 0; i < num_triangles_to_render; i++) {
+                int *r = ranges[i];
+                for (int ty = r[1]; ty <= r[3]; ty++) {
+                        for (int tx = r[0]; tx <= r[2]; tx++) tile_indices[cursor[ty * tiles_x + tx]++] = i;
+                }
+        }
+}
+
+// every tile owns a disjoint part of color_buffer and z_buffer, no locking needed
+static void raster_tile_job(void *ctx, int tile) {
+        (void)ctx;
+        int tx = tile % tiles_x;
+        int ty = tile / tiles_x;
+        rect_t clip = {
+                .x_min = tx * TILE_SIZE,
+                .y_min = ty * TILE_SIZE,
+                .x_max = MIN((tx + 1) * TILE_SIZE, window_width) - 1,
+                .y_max = MIN((ty + 1) * TILE_SIZE, window_height) - 1,
+        };
+
+        for (int i = tile_offsets[tile]; i < tile_offsets[tile + 1]; i++) {
+                draw_render_triangle(tile_indices[i], &clip);
+        }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// write the current frame to dump_dir if it was selected on the command line
+/////////////////////////////////////////////////////////////////////////////////////////
+static void dump_frame(void) {
+        if (!dump_dir) return;
+
+        bool last = max_frames > 0 && frame_count == max_frames - 1;
+        bool selected = dump_every > 0 && frame_count % dump_every == 0;
+        if (!last && !selected) return;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/frame_%04d.ppm", dump_dir, frame_count);
+        write_color_buffer_ppm(path);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// save the buffers as the reference of the current golden scene, or compare them with it
+/////////////////////////////////////////////////////////////////////////////////////////
+static void capture_golden(void) {
+        bool ok = golden_writing ?
+                golden_write(golden_dir, golden_name) :
+                golden_check(golden_dir, golden_name, golden_variant, golden_color_tolerance, golden_depth_tolerance);
+        if (!ok) golden_passed = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// benchmark counters of the current frame
+// pixels with a depth value were written by a filled or textured triangle, the
+// wireframe methods don't touch the z-buffer and count no pixels
+/////////////////////////////////////////////////////////////////////////////////////////
+static void count_bench_frame(void) {
+        uint64_t start = SDL_GetPerformanceCounter();
+
+        bench_triangles += num_triangles_to_render;
+        for (int i = 0; i < window_width * window_height; i++) {
+                if (z_buffer[i] <= 1.0f) bench_pixels++;
+        }
+
+        bench_overhead += SDL_GetPerformanceCounter() - start;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// profiler hud, rolling averages of the last frames
+//    frames per second
+//    one bar with a segment per stage, 1 pixel per 50us
+//    a color swatch and the microseconds of every stage, the whole frame last
+/////////////////////////////////////////////////////////////////////////////////////////
+static void draw_profile_hud(void) {
+        int x = 30;
+        int y = 30;
+
+        int frame_us = prof_average_us(PROF_FRAME);
+        draw_simple_integer(frame_us > 0 ? 1000000 / frame_us : 0, x, y, 6);
+        y += 20;
+
+        int bar_x = x;
+        for (int i = 0; i < PROF_FRAME; i++) {
+                int width = prof_average_us(i) / 50;
+                draw_rect(bar_x, y, width, 8, prof_stage_colors[i], NULL);
+                bar_x += width;
+        }
+        y += 16;
+
+        for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+                draw_rect(x, y, 10, 10, prof_stage_colors[i], NULL);
+                draw_simple_integer(prof_average_us(i), x + 16, y, 5);
+                y += 15;
+        }
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////
 // render function to draw objects on the display
 /////////////////////////////////////////////////////////////////////////////////////////
 static void render(void) {
         if (paused) return;
 
+        uint64_t start = prof_now();
         draw_grid(GRID_COLOR);
+        prof_add(PROF_GRID, prof_now() - start);
 
         // loop all projected triangles and render them
-        for (int i = 0; i < darray_size(triangles_to_render); i++) {
-                triangle_t triangle = triangles_to_render[i];
-
-                // draw filled triangle
-                if (render_method == RENDER_FILL_TRIANGLE || render_method == RENDER_FILL_TRIANGLE_WIRE) {
-                        // draw_filled_triangle(
-                        //         triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w,
-                        //         triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w,
-                        //         triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w,
-                        //         z_buffer, triangle.color
-                        // );
-
-                        draw_filled_triangle_v2(
-                                &triangle.points[0],
-                                &triangle.points[1],
-                                &triangle.points[2],
-                                z_buffer, triangle.color
-                        );
+        start = prof_now();
+        if (raster_method == RASTER_TILED) {
+                bin_triangles();
+                jobs_run(tiles_x * tiles_y, raster_tile_job, NULL);
+        } else {
+                for (int i = 0; i < num_triangles_to_render; i++) {
+                        draw_render_triangle(i, NULL);
                 }
+        }
+        prof_add(PROF_RASTER, prof_now() - start);
 
-                // draw textured triangle
-                if (render_method == RENDER_TEXTURED || render_method == RENDER_TEXTURED_WIRE) {
-                        draw_textured_triangle(
-                                triangle.points[0].x, triangle.points[0].y, triangle.points[0].z, triangle.points[0].w, triangle.texcoords[0].u, triangle.texcoords[0].v,
-                                triangle.points[1].x, triangle.points[1].y, triangle.points[1].z, triangle.points[1].w, triangle.texcoords[1].u, triangle.texcoords[1].v,
-                                triangle.points[2].x, triangle.points[2].y, triangle.points[2].z, triangle.points[2].w, triangle.texcoords[2].u, triangle.texcoords[2].v,
-                                z_buffer, mesh_texture, texture_width, texture_height
-                        );
+        if (bench) count_bench_frame();
+
+        // ui stuff
+        start = prof_now();
+        if (show_hud) draw_profile_hud();
+        prof_add(PROF_HUD, prof_now() - start);
+
+        // drop the per-frame geometry, the next frame reuses the memory
+        arena_reset(&frame_arena);
+        triangles_to_render = NULL;
+        texcoords_to_render = NULL;
+        num_triangles_to_render = 0;
+
+        start = prof_now();
+        if (renderer) render_color_buffer();
+        prof_add(PROF_PRESENT, prof_now() - start);
+        dump_frame();
+        if (golden_name) capture_golden();
+
+        start = prof_now();
+        clear_color_buffer(BG_COLOR);
+        clear_z_buffer(z_buffer, window_height * window_width);
+        prof_add(PROF_CLEAR, prof_now() - start);
+
+        start = prof_now();
+        if (renderer) SDL_RenderPresent(renderer);
+        prof_add(PROF_PRESENT, prof_now() - start);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// free the memory that was dynamically allocated by the program
+/////////////////////////////////////////////////////////////////////////////////////////
+static void free_resources(void) {
+        free(color_buffer);
+        free_mesh();
+        arena_free(&frame_arena);
+        free_png_texture();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// benchmark
+// every asset under every render method, each run
+// renders max_frames frames of the same orbit from reset_scene() with a fixed delta_time,
+// the results go to stdout as csv
+/////////////////////////////////////////////////////////////////////////////////////////
+#define BENCH_FRAMES 120
+static const char *bench_assets[] = { "cube", "f22", "f117", "efa", "suzanne", "sphere", "crab", "drone" };
+
+static const char *render_method_names[] = {
+        [RENDER_WIRE] = "wire",
+        [RENDER_WIRE_VERTEX] = "wire_vertex",
+        [RENDER_FILL_TRIANGLE] = "fill",
+        [RENDER_FILL_TRIANGLE_WIRE] = "fill_wire",
+        [RENDER_TEXTURED] = "textured",
+        [RENDER_TEXTURED_WIRE] = "textured_wire",
+};
+
+static void load_asset(const char *name) {
+        char path[256];
+        snprintf(path, sizeof(path), "./assets/%s.obj", name);
+        // the bench and golden runs compare against fixed assets, there is nothing to fall back to
+        if (!load_obj(path)) exit(1);
+
+        // not every model has a texture, those are textured with the red bricks
+        snprintf(path, sizeof(path), "./assets/%s.png", name);
+        FILE *fp = fopen(path, "rb");
+        if (fp) {
+                fclose(fp);
+                if (!load_png_texture(path)) exit(1);
+        } else {
+                load_redbrick_texture();
+        }
+}
+
+static void unload_asset(void) {
+        free_mesh();
+        free_png_texture();
+}
+
+static void bench_run(const char *asset) {
+        // one frame to warm the caches and grow the per-frame buffers, then start over
+        reset_scene();
+        update();
+        render();
+        reset_scene();
+
+        bench_triangles = 0;
+        bench_pixels = 0;
+        bench_overhead = 0;
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        for (; frame_count < max_frames; frame_count++) {
+                prof_begin_frame();
+                update();
+                render();
+                prof_end_frame();
+        }
+        uint64_t ticks = SDL_GetPerformanceCounter() - start - bench_overhead;
+
+        double seconds = (double)ticks / SDL_GetPerformanceFrequency();
+        printf("%s,%s,%d,%.1f,%.3f,%.0f,%.0f\n",
+               asset, render_method_names[render_method], max_frames,
+               (double)bench_triangles / max_frames,
+               seconds * 1000.0 / max_frames,
+               bench_triangles / seconds,
+               bench_pixels / seconds);
+        fflush(stdout);
+}
+
+static void run_bench(void) {
+        printf("asset,render_method,frames,triangles_per_frame,ms_per_frame,triangles_per_s,pixels_per_s\n");
+
+        for (int a = 0; a < (int)(sizeof(bench_assets) / sizeof(bench_assets[0])); a++) {
+                load_asset(bench_assets[a]);
+
+                for (int m = RENDER_WIRE; m <= RENDER_TEXTURED_WIRE; m++) {
+                        render_method = m;
+                        bench_run(bench_assets[a]);
                 }
 
-                // draw triangle wireframe
-                if (render_method == RENDER_WIRE || render_method == RENDER_WIRE_VERTEX || render_method == RENDER_TEXTURED_WIRE) {
-                        draw_triangle(
-                                triangle.points[0].x, triangle.points[0].y,
-                                triangle.points[1].x, triangle.points[1].y,
-                                triangle.points[2].x, triangle.points[2].y,
-                                triangle.color
+                unload_asset();
+        }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// golden images
+// fixed scenes through every rasterizer path, the references are written by one build and
+// checked by another, so a change to the rasterizers can be shown not to change the output
+// tiled and serial rasterization must give the same image,
+// the references are written with the first variant and every variant is checked
+// no scene may spill a chunk, see TRIANGLES_PER_FACE, the ones without culling show that
+// a slice holds every face of a chunk
+/////////////////////////////////////////////////////////////////////////////////////////
+#define GOLDEN_FRAME 20 // the scenes are captured at this frame of the orbit
+
+typedef struct {
+        const char *name;
+        const char *asset;
+        enum render_method render_method;
+        float scale;
+        enum perspective_span perspective_span;
+        bool mipmapping;
+        enum cull_method cull_method;
+} golden_scene_t;
+
+static const golden_scene_t golden_scenes[] = {
+        { "crab_wire_vertex", "crab", RENDER_WIRE_VERTEX, 1.3, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        { "crab_fill_wire", "crab", RENDER_FILL_TRIANGLE_WIRE, 1.3, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        { "crab_textured", "crab", RENDER_TEXTURED, 1.3, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        { "crab_textured_no_mips", "crab", RENDER_TEXTURED, 1.3, PERSPECTIVE_EXACT, false, CULL_BACKFACE },
+        { "crab_textured_span_8", "crab", RENDER_TEXTURED, 1.3, PERSPECTIVE_SPAN_8, true, CULL_BACKFACE },
+        { "crab_textured_span_16", "crab", RENDER_TEXTURED, 1.3, PERSPECTIVE_SPAN_16, true, CULL_BACKFACE },
+        // big triangles, and the near plane cuts through the mesh
+        { "crab_near_textured", "crab", RENDER_TEXTURED, 5.0, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        { "cube_near_fill", "cube", RENDER_FILL_TRIANGLE, 3.0, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        { "cube_near_textured_wire", "cube", RENDER_TEXTURED_WIRE, 3.0, PERSPECTIVE_EXACT, true, CULL_BACKFACE },
+        // every face reaches the clipper
+        { "crab_fill_no_cull", "crab", RENDER_FILL_TRIANGLE, 1.3, PERSPECTIVE_EXACT, true, CULL_NONE },
+        { "crab_near_textured_no_cull", "crab", RENDER_TEXTURED, 5.0, PERSPECTIVE_EXACT, true, CULL_NONE },
+};
+
+// the scanline rasterizer isn't used by any render method, it draws a fixed set of triangles
+static void draw_golden_legacy_triangles(void) {
+        for (int j = 0; j < 4; j++) {
+                for (int i = 0; i < 6; i++) {
+                        int x = 40 + i * 120;
+                        int y = 40 + j * 130;
+                        draw_filled_triangle(
+                                x, y, 0.2 + 0.1 * i, 1.0,
+                                x + 100 - i * 10, y + 20 + j * 15, 0.3, 1.0 + 0.2 * j,
+                                x + 30 + j * 10, y + 110 - i * 8, 0.8 - 0.1 * j, 2.0,
+                                z_buffer, 0xFF000000 | (0x2A * i) << 8 | (0x40 * j)
                         );
                 }
+        }
 
-                // draw triangle vertex points
-                if (render_method == RENDER_WIRE_VERTEX) {
-                        for (int j = 0; j < 3; j++) {
-                                vec4_t point = triangles_to_render[i].points[j];
-                                draw_rect(point.x - 1, point.y - 1, 6, 6, 0xFFFFFFFF);
-                        }
+        // overlapping triangles for the depth test
+        draw_filled_triangle(100, 100, 0.5, 1.0, 700, 150, 0.5, 1.0, 300, 500, 0.5, 1.0, z_buffer, 0xFFFFFFFF);
+        draw_filled_triangle(650, 80, 0.1, 1.0, 200, 300, 0.9, 1.0, 600, 560, 0.4, 1.0, z_buffer, 0xFF3030E0);
+}
+
+// lines in every octant, from the center of the window
+static void draw_golden_lines(void) {
+        int cx = window_width / 2;
+        int cy = window_height / 2;
+        for (int i = 0; i < 32; i++) {
+                int dx = (i % 8) * 40 - 140;
+                int dy = (i / 8) * 70 - 105 + (i % 3) * 11;
+                draw_line(cx, cy, cx + dx * 2, cy + dy * 2, 0xFF00FF00 | (i * 8) << 16, NULL);
+        }
+        draw_line(0, 0, window_width - 1, window_height - 1, 0xFFFFFFFF, NULL);
+        draw_line(window_width - 1, 0, 0, window_height - 1, 0xFFFFFFFF, NULL);
+}
+
+// render the orbit up to GOLDEN_FRAME and capture that frame
+static void run_golden_scene(const golden_scene_t *scene, enum raster_method raster, const char *variant) {
+        render_method = scene->render_method;
+        perspective_span = scene->perspective_span;
+        mipmapping = scene->mipmapping;
+        cull_method = scene->cull_method;
+        raster_method = raster;
+
+        reset_scene();
+        mesh.scale = (vec3_t){scene->scale, scene->scale, scene->scale};
+
+        int num_spilled = 0;
+        for (; frame_count <= GOLDEN_FRAME; frame_count++) {
+                if (frame_count == GOLDEN_FRAME) {
+                        golden_name = scene->name;
+                        golden_variant = variant;
                 }
+                update();
+                render();
+                num_spilled += num_spilled_chunks;
         }
+        golden_name = NULL;
+        cull_method = CULL_BACKFACE;
 
-        // ui stuff
-        // draw FPS counter
-        draw_simple_integer(fps, 30, 30, 9);
-        draw_simple_integer(darray_size(triangles_to_render), 30, 60, 9);
-        draw_simple_integer(previous_frame_time / 1000, 30, 90, 9);
+        if (num_spilled > 0) {
+                fprintf(stderr, "%s (%s): %d chunks spilled\n", scene->name, variant, num_spilled);
+                golden_passed = false;
+        }
+}
+
+static void run_golden_drawing(const char *name, void (*draw)(void)) {
+        clear_color_buffer(BG_COLOR);
+        clear_z_buffer(z_buffer, window_height * window_width);
 
-        // clear the array of triangles to render every frame loop
-        // we don't need to throw it away, just reuse the memory we allocated
-        darray_clear(triangles_to_render);
+        draw();
 
-        render_color_buffer();
+        golden_name = name;
+        golden_variant = "direct";
+        capture_golden();
+        golden_name = NULL;
 
         clear_color_buffer(BG_COLOR);
         clear_z_buffer(z_buffer, window_height * window_width);
+}
+
+static void run_golden(void) {
+        run_golden_drawing("legacy_triangles", draw_golden_legacy_triangles);
+        run_golden_drawing("lines", draw_golden_lines);
+
+        for (int i = 0; i < (int)(sizeof(golden_scenes) / sizeof(golden_scenes[0])); i++) {
+                const golden_scene_t *scene = &golden_scenes[i];
+                load_asset(scene->asset);
+
+                run_golden_scene(scene, RASTER_TILED, "tiled");
+                if (!golden_writing) run_golden_scene(scene, RASTER_SERIAL, "serial");
 
-        SDL_RenderPresent(renderer);
+                unload_asset();
+        }
+
+        if (golden_writing && !golden_save_hashes(golden_dir)) golden_passed = false;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////
-// free the memory that was dynamically allocated by the program
+// command line
+//    --headless      render without a window, defaults to a single frame
+//    --frames n      exit after n frames
+//    --dump dir      write frames to dir/frame_NNNN.ppm, the last frame by default
+//    --dump-every n  also write every n-th frame, starting with the first one
+//    --bench         headless benchmark, csv to stdout, --frames sets the frames per run
+//    --profile file  write per-frame stage timings to file, the same as pressing "r"
+//    --golden-write dir            render the golden scenes headless and save them to dir
+//    --golden-check dir            render the golden scenes headless and compare them with dir,
+//                                  exits with 1 if any pixel is out of tolerance
+//    --golden-tolerance n          allowed difference per color channel, 0 by default
+//    --golden-depth-tolerance f    allowed difference per depth value, 0 by default
+//    --scalar        never take the sse2 and avx2 paths, e.g. to check the fallbacks against the golden images
 /////////////////////////////////////////////////////////////////////////////////////////
-static void free_resources(void) {
-        free(color_buffer);
-        darray_free(mesh.vertices);
-        darray_free(mesh.faces);
+static bool parse_args(int argc, char *argv[]) {
+        for (int i = 1; i < argc; i++) {
+                bool has_value = i + 1 < argc;
+                if (strcmp(argv[i], "--headless") == 0) {
+                        headless = true;
+                } else if (strcmp(argv[i], "--bench") == 0) {
+                        bench = true;
+                        headless = true;
+                } else if (strcmp(argv[i], "--frames") == 0 && has_value) {
+                        max_frames = atoi(argv[++i]);
+                        if (max_frames <= 0) {
+                                fprintf(stderr, "--frames expects a positive number\n");
+                                return false;
+                        }
+                } else if ((strcmp(argv[i], "--golden-write") == 0 || strcmp(argv[i], "--golden-check") == 0) && has_value) {
+                        golden_writing = strcmp(argv[i], "--golden-write") == 0;
+                        golden_dir = argv[++i];
+                        headless = true;
+                } else if (strcmp(argv[i], "--golden-tolerance") == 0 && has_value) {
+                        golden_color_tolerance = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "--golden-depth-tolerance") == 0 && has_value) {
+                        golden_depth_tolerance = atof(argv[++i]);
+                } else if (strcmp(argv[i], "--scalar") == 0) {
+                        cpu_force_scalar();
+                        upng_set_simd(0);
+                } else if (strcmp(argv[i], "--profile") == 0 && has_value) {
+                        profile_path = argv[++i];
+                } else if (strcmp(argv[i], "--dump") == 0 && has_value) {
+                        dump_dir = argv[++i];
+                } else if (strcmp(argv[i], "--dump-every") == 0 && has_value) {
+                        dump_every = atoi(argv[++i]);
+                        if (dump_every <= 0) {
+                                fprintf(stderr, "--dump-every expects a positive number\n");
+                                return false;
+                        }
+                } else {
+                        fprintf(stderr, "usage: %s [--headless] [--frames n] [--dump dir] [--dump-every n] [--bench] [--profile file]\n"
+                                        "       [--golden-write dir | --golden-check dir] [--golden-tolerance n] [--golden-depth-tolerance f] [--scalar]\n", argv[0]);
+                        return false;
+                }
+        }
+
+        // there is no window to close, a headless run has to end by itself
+        if (bench && max_frames == 0) max_frames = BENCH_FRAMES;
+        if (headless && max_frames == 0) max_frames = 1;
+        if (bench) dump_dir = NULL; /* every run would overwrite the frames of the last one */
+
+        // the hud shows timings, they would make every dumped frame different
+        if (headless) show_hud = false;
+        return true;
 }
 
-int main(void) {
-        is_running = initialize_window();
+int main(int argc, char *argv[]) {
+        if (!parse_args(argc, argv)) return 1;
+
+        is_running = headless ? initialize_headless() : initialize_window();
         setup();
 
+        if (profile_path && !prof_csv_open(profile_path)) is_running = false;
+
+        if (bench && is_running) {
+                run_bench();
+                is_running = false;
+        }
+
+        if (golden_dir && is_running) {
+                run_golden();
+                is_running = false;
+        }
+
         while(is_running) {
-                process_input();
+                prof_begin_frame();
+                apply_loaded_assets();
+                if (!headless) {
+                        uint64_t start = prof_now();
+                        process_input();
+                        prof_add(PROF_INPUT, prof_now() - start);
+                }
                 update();
                 render();
+                prof_end_frame();
+
+                frame_count++;
+                if (max_frames > 0 && frame_count >= max_frames) is_running = false;
         }
 
+        // before the job pool, a loader thread may still be parsing on it
+        loader_shutdown();
+        jobs_shutdown();
+        prof_csv_close();
         destroy_window();
         free_resources();
-        return 0;
+        return golden_passed ? 0 : 1;
 }
@@ -1,5 +1,11 @@
 #include <math.h>
 #include "matrix.h"
+#include "util.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MATRIX_SIMD_X86
+#endif
 
 mat4_t mat4_eye(void) {
         // | 1  0  0  0 |
@@ -89,6 +95,106 @@ vec4_t mat4_mul_vec4(mat4_t m, vec4_t v) {
         return ret;
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// Batch transform of positions stored as separate x, y and z arrays, m * (x[i], y[i], z[i], 1) => out[i]
+// every path does the same multiplies and adds in the same order as mat4_mul_vec4
+// (no fma), so the results are bit-identical to the scalar version
+/////////////////////////////////////////////////////////////////////////////////////////
+static void mat4_mul_vec4_batch_scalar(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count) {
+        for (int i = 0; i < count; i++) {
+                out[i] = mat4_mul_vec4(*m, (vec4_t){ x[i], y[i], z[i], 1.0 });
+        }
+}
+
+#ifdef MATRIX_SIMD_X86
+// 4 vertices per iteration
+__attribute__((target("sse2")))
+static void mat4_mul_vec4_batch_sse2(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count) {
+        __m128 r[4][4];
+        for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) r[i][j] = _mm_set1_ps(m->m[i][j]);
+        }
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+                __m128 vx = _mm_loadu_ps(&x[i]);
+                __m128 vy = _mm_loadu_ps(&y[i]);
+                __m128 vz = _mm_loadu_ps(&z[i]);
+
+                __m128 o[4];
+                for (int k = 0; k < 4; k++) {
+                        __m128 acc = _mm_add_ps(_mm_mul_ps(r[k][0], vx), _mm_mul_ps(r[k][1], vy));
+                        acc = _mm_add_ps(acc, _mm_mul_ps(r[k][2], vz));
+                        o[k] = _mm_add_ps(acc, r[k][3]);
+                }
+
+                // x, y, z, w lanes => 4 packed vec4_t
+                _MM_TRANSPOSE4_PS(o[0], o[1], o[2], o[3]);
+                float *f = (float *)&out[i];
+                _mm_storeu_ps(f, o[0]);
+                _mm_storeu_ps(f + 4, o[1]);
+                _mm_storeu_ps(f + 8, o[2]);
+                _mm_storeu_ps(f + 12, o[3]);
+        }
+
+        mat4_mul_vec4_batch_scalar(m, x + i, y + i, z + i, out + i, count - i);
+}
+
+// 8 vertices per iteration
+__attribute__((target("avx2")))
+static void mat4_mul_vec4_batch_avx2(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count) {
+        __m256 r[4][4];
+        for (int i = 0; i < 4; i++) {
+                for (int j = 0; j < 4; j++) r[i][j] = _mm256_set1_ps(m->m[i][j]);
+        }
+
+        int i = 0;
+        for (; i + 8 <= count; i += 8) {
+                __m256 vx = _mm256_loadu_ps(&x[i]);
+                __m256 vy = _mm256_loadu_ps(&y[i]);
+                __m256 vz = _mm256_loadu_ps(&z[i]);
+
+                __m256 o[4];
+                for (int k = 0; k < 4; k++) {
+                        __m256 acc = _mm256_add_ps(_mm256_mul_ps(r[k][0], vx), _mm256_mul_ps(r[k][1], vy));
+                        acc = _mm256_add_ps(acc, _mm256_mul_ps(r[k][2], vz));
+                        o[k] = _mm256_add_ps(acc, r[k][3]);
+                }
+
+                // x, y, z, w lanes => 8 packed vec4_t, one 4x4 transpose per 128-bit half
+                __m128 lo[4], hi[4];
+                for (int k = 0; k < 4; k++) {
+                        lo[k] = _mm256_castps256_ps128(o[k]);
+                        hi[k] = _mm256_extractf128_ps(o[k], 1);
+                }
+                _MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+                _MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+                float *f = (float *)&out[i];
+                for (int k = 0; k < 4; k++) {
+                        _mm_storeu_ps(f + k * 4, lo[k]);
+                        _mm_storeu_ps(f + 16 + k * 4, hi[k]);
+                }
+        }
+
+        mat4_mul_vec4_batch_sse2(m, x + i, y + i, z + i, out + i, count - i);
+}
+#endif
+
+void mat4_mul_vec4_batch(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count) {
+#ifdef MATRIX_SIMD_X86
+        // pick the widest path the cpu supports
+        if (cpu_has_avx2()) {
+                mat4_mul_vec4_batch_avx2(m, x, y, z, out, count);
+                return;
+        }
+        if (cpu_has_sse2()) {
+                mat4_mul_vec4_batch_sse2(m, x, y, z, out, count);
+                return;
+        }
+#endif
+        mat4_mul_vec4_batch_scalar(m, x, y, z, out, count);
+}
+
 mat4_t mat4_mul_mat4(mat4_t ma, mat4_t mb) {
         mat4_t m = mat4_eye();
 
@@ -14,6 +14,7 @@ mat4_t mat4_make_rotation_x(float r);
 mat4_t mat4_make_rotation_y(float r);
 mat4_t mat4_make_rotation_z(float r);
 vec4_t mat4_mul_vec4(mat4_t m, vec4_t v);
+void mat4_mul_vec4_batch(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count);
 mat4_t mat4_mul_mat4(mat4_t a, mat4_t b);
 mat4_t mat4_make_orthographic(float fov, int wh, int ww, float zn, float zf);
 mat4_t mat4_make_perspective(float fov, int wh, int ww, float zn, float zf);
@@ -1,15 +1,16 @@
 #include "mesh.h"
 #include "darray.h"
+#include "jobs.h"
 #include "vector.h"
 #include "util.h"
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include "settings.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_LINE 1024
 vec3_t cube_vertices[N_CUBE_VERTICES] = {
         {-1, -1, -1},  // 1
         {-1,  1, -1},  // 2
@@ -42,115 +43,691 @@ face_t cube_faces[N_CUBE_FACES] = {
         {.a = 6, .b = 1, .c = 4, .a_uv = {0, 0}, .b_uv = {1, 1}, .c_uv = {1, 0}, .color = DEMO_CUBE_COLOR},
 };
 
-void load_cube_mesh_data(void) {
-        for (int i = 0; i < N_CUBE_VERTICES; i++) {
-                vec3_t vertex = cube_vertices[i];
-                darray_push(mesh.vertices, vertex);
+/////////////////////////////////////////////////////////////////////////////////////////
+// replace the data of m, indices and uv_indices are 0-based with 3 per face
+// every array is copied into m->storage
+/////////////////////////////////////////////////////////////////////////////////////////
+static void build_mesh(
+        mesh_t *m,
+        const vec3_t *vertices, int num_vertices,
+        const tex2_t *uvs, int num_uvs,
+        const uint32_t *indices, const uint32_t *uv_indices, int num_faces,
+        uint32_t color
+) {
+        destroy_mesh(m);
+
+        int index_size = num_vertices <= UINT16_MAX + 1 && num_uvs <= UINT16_MAX + 1 ? 2 : 4;
+        size_t size = sizeof(float) * num_vertices * 3 + sizeof(tex2_t) * num_uvs + (size_t)index_size * num_faces * 3 * 2;
+        arena_reserve(&m->storage, size + 6 * ARENA_ALIGNMENT);
+
+        m->x = (float *)arena_alloc(&m->storage, sizeof(float) * num_vertices);
+        m->y = (float *)arena_alloc(&m->storage, sizeof(float) * num_vertices);
+        m->z = (float *)arena_alloc(&m->storage, sizeof(float) * num_vertices);
+        m->bounds_min = m->bounds_max = num_vertices > 0 ? vertices[0] : (vec3_t){ 0, 0, 0 };
+        for (int i = 0; i < num_vertices; i++) {
+                m->x[i] = vertices[i].x;
+                m->y[i] = vertices[i].y;
+                m->z[i] = vertices[i].z;
+
+                m->bounds_min.x = MIN(m->bounds_min.x, vertices[i].x);
+                m->bounds_min.y = MIN(m->bounds_min.y, vertices[i].y);
+                m->bounds_min.z = MIN(m->bounds_min.z, vertices[i].z);
+                m->bounds_max.x = MAX(m->bounds_max.x, vertices[i].x);
+                m->bounds_max.y = MAX(m->bounds_max.y, vertices[i].y);
+                m->bounds_max.z = MAX(m->bounds_max.z, vertices[i].z);
         }
+        m->num_vertices = num_vertices;
+
+        m->uvs = (tex2_t *)arena_alloc(&m->storage, sizeof(tex2_t) * num_uvs);
+        if (num_uvs > 0) memcpy(m->uvs, uvs, sizeof(tex2_t) * num_uvs);
+        m->num_uvs = num_uvs;
 
+        m->indices = arena_alloc(&m->storage, (size_t)index_size * num_faces * 3);
+        m->uv_indices = arena_alloc(&m->storage, (size_t)index_size * num_faces * 3);
+        for (int i = 0; i < num_faces * 3; i++) {
+                assert(indices[i] < (uint32_t)num_vertices && uv_indices[i] < (uint32_t)num_uvs);
+                if (index_size == 2) {
+                        ((uint16_t *)m->indices)[i] = (uint16_t)indices[i];
+                        ((uint16_t *)m->uv_indices)[i] = (uint16_t)uv_indices[i];
+                } else {
+                        ((uint32_t *)m->indices)[i] = indices[i];
+                        ((uint32_t *)m->uv_indices)[i] = uv_indices[i];
+                }
+        }
+        m->index_size = index_size;
+        m->num_faces = num_faces;
+        m->color = color;
+}
+
+// frees the data of m, its transform stays
+void destroy_mesh(mesh_t *m) {
+        arena_free(&m->storage);
+        unmap_file(&m->cache);
+        m->x = m->y = m->z = NULL;
+        m->uvs = NULL;
+        m->indices = m->uv_indices = NULL;
+        m->num_vertices = m->num_uvs = m->num_faces = 0;
+}
+
+void free_mesh(void) {
+        destroy_mesh(&mesh);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the global mesh takes over the data of loaded, its own data is freed and its transform
+// stays, loaded is left empty
+/////////////////////////////////////////////////////////////////////////////////////////
+void replace_mesh(mesh_t *loaded) {
+        destroy_mesh(&mesh);
+
+        vec3_t rotation = mesh.rotation;
+        vec3_t scale = mesh.scale;
+        vec3_t translation = mesh.translation;
+        mesh = *loaded;
+        mesh.rotation = rotation;
+        mesh.scale = scale;
+        mesh.translation = translation;
+
+        *loaded = (mesh_t){0};
+}
+
+void load_cube_mesh_data(void) {
+        // every face corner gets its own uv, the cube is too small to bother sharing them
+        tex2_t uvs[N_CUBE_FACES * 3];
+        uint32_t indices[N_CUBE_FACES * 3];
+        uint32_t uv_indices[N_CUBE_FACES * 3];
         for (int i = 0; i < N_CUBE_FACES; i++) {
                 face_t face = cube_faces[i];
-                darray_push(mesh.faces, face);
+                indices[3 * i + 0] = face.a - 1;
+                indices[3 * i + 1] = face.b - 1;
+                indices[3 * i + 2] = face.c - 1;
+                uvs[3 * i + 0] = face.a_uv;
+                uvs[3 * i + 1] = face.b_uv;
+                uvs[3 * i + 2] = face.c_uv;
+                for (int k = 0; k < 3; k++) uv_indices[3 * i + k] = 3 * i + k;
         }
+
+        build_mesh(&mesh, cube_vertices, N_CUBE_VERTICES, uvs, N_CUBE_FACES * 3, indices, uv_indices, N_CUBE_FACES, DEMO_CUBE_COLOR);
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////
+// obj parsing
+// the file is mapped and split into chunks of whole lines that are parsed in parallel,
+// numbers are parsed by hand, sscanf goes through the locale and format string machinery
+// for every single value
+/////////////////////////////////////////////////////////////////////////////////////////
+#define OBJ_NO_UV UINT32_MAX       // face corner without a vt index
+#define OBJ_MIN_CHUNK_SIZE (1 << 20) // smaller files are parsed by a single task
+#define OBJ_CHUNKS_PER_THREAD 4      // a few chunks per thread even out their different costs
+
+typedef struct {
+        const char *p;
+        const char *end;
+        const char *error;    // the first error, NULL while there is none
+        const char *error_at; // where it was found, for the line number
+} obj_scanner_t;
+
 /*
- * return the word size of EOF
+ * the scanners run on the job pool, so an error only stops the scanner: it keeps the first
+ * error and jumps to the end of its chunk, the caller of the job reports it
+ * the caller stops scanning right away, nothing after the error is used
  */
-int read_word(FILE *fp, char *word, int max_char) {
-        int c = 0;
-        int n = 0;
-        for (n = 0; (c = fgetc(fp)) != EOF && c != ' ' && c != '\n' && n < max_char - 1; n++) {
-                *(word++) = c;
+static void obj_error(obj_scanner_t *s, const char *message) {
+        if (s->error == NULL) {
+                s->error = message;
+                s->error_at = s->p;
+        }
+        s->p = s->end;
+}
+
+static void skip_spaces(obj_scanner_t *s) {
+        while (s->p < s->end && (*s->p == ' ' || *s->p == '\t')) s->p++;
+}
+
+// a comment ends the line as well
+static bool at_line_end(const obj_scanner_t *s) {
+        return s->p == s->end || *s->p == '\n' || *s->p == '\r' || *s->p == '#';
+}
+
+static void next_line(obj_scanner_t *s) {
+        const char *newline = memchr(s->p, '\n', s->end - s->p);
+        s->p = newline ? newline + 1 : s->end;
+}
+
+// the keyword at the start of the line followed by a space, consumed when it matches
+static bool scan_keyword(obj_scanner_t *s, const char *keyword) {
+        size_t n = strlen(keyword);
+        if ((size_t)(s->end - s->p) <= n || memcmp(s->p, keyword, n) != 0) return false;
+        if (s->p[n] != ' ' && s->p[n] != '\t') return false;
+        s->p += n;
+        return true;
+}
+
+static bool is_digit(char c) {
+        return c >= '0' && c <= '9';
+}
+
+/*
+ * [+-]digits[.digits][(e|E)[+-]digits], the digits go into an integer mantissa and the value
+ * is scaled by an exact power of ten once, so the usual 6 decimal places convert exactly
+ */
+static bool scan_float(obj_scanner_t *s, float *out) {
+        static const double powers_of_ten[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        skip_spaces(s);
+        const char *p = s->p;
+        bool negative = false;
+        if (p < s->end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        for (; p < s->end && is_digit(*p); p++, digits++) {
+                // digits past what a double can hold only move the decimal point
+                if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (*p - '0');
+                else exponent++;
+        }
+        if (p < s->end && *p == '.') {
+                for (p++; p < s->end && is_digit(*p); p++, digits++) {
+                        if (mantissa < 100000000000000000ull) {
+                                mantissa = mantissa * 10 + (*p - '0');
+                                exponent--;
+                        }
+                }
         }
+        if (digits == 0) return false;
 
-        *(word++) = '\0';
-        return c == EOF ? EOF : n;
+        if (p < s->end && (*p == 'e' || *p == 'E')) {
+                p++;
+                bool negative_exponent = false;
+                if (p < s->end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+                if (p == s->end || !is_digit(*p)) return false;
+                int e = 0;
+                for (; p < s->end && is_digit(*p); p++) {
+                        if (e < 10000) e = e * 10 + (*p - '0');
+                }
+                exponent += negative_exponent ? -e : e;
+        }
+
+        double value = (double)mantissa;
+        if (exponent < 0) {
+                value = exponent >= -22 ? value / powers_of_ten[-exponent] : value * pow(10.0, exponent);
+        } else if (exponent > 0) {
+                value = exponent <= 22 ? value * powers_of_ten[exponent] : value * pow(10.0, exponent);
+        }
+        *out = (float)(negative ? -value : value);
+        s->p = p;
+        return true;
 }
 
-bool str_cmp(char *s1, char *s2) {
-        char c;
-        while ((c = *s1++) && c == *s2++);
-        return *s1 == *s2 ? true : false;
+/*
+ * a 1-based index, or a negative one counting back from the last of the count elements
+ * read so far, returned 0-based
+ * positive indices are checked once the whole file is read
+ */
+static bool scan_index(obj_scanner_t *s, int count, uint32_t *out) {
+        const char *p = s->p;
+        bool negative = p < s->end && *p == '-';
+        if (negative) p++;
+        if (p == s->end || !is_digit(*p)) return false;
+
+        int64_t value = 0;
+        for (; p < s->end && is_digit(*p); p++) {
+                if (value <= UINT32_MAX) value = value * 10 + (*p - '0');
+        }
+        if (negative) value = count - value;
+        else value = value - 1;
+        if (value < 0 || value >= UINT32_MAX) {
+                obj_error(s, "face index out of range");
+                return false;
+        }
+
+        *out = (uint32_t)value;
+        s->p = p;
+        return true;
+}
+
+// one corner of a face: v, v/vt, v//vn or v/vt/vn, normals are not used, false after an error
+static bool scan_corner(obj_scanner_t *s, int num_vertices, int num_uvs, uint32_t *vertex, uint32_t *uv) {
+        if (!scan_index(s, num_vertices, vertex)) {
+                obj_error(s, "expected a vertex index");
+                return false;
+        }
+
+        *uv = OBJ_NO_UV;
+        if (s->p == s->end || *s->p != '/') return true;
+        s->p++;
+        if (s->p < s->end && *s->p != '/') {
+                if (!scan_index(s, num_uvs, uv)) {
+                        obj_error(s, "expected a texture coordinate index");
+                        return false;
+                }
+        }
+
+        if (s->p == s->end || *s->p != '/') return true;
+        s->p++;
+        uint32_t normal;
+        if (!scan_index(s, INT32_MAX, &normal)) {
+                obj_error(s, "expected a normal index");
+                return false;
+        }
+        return true;
+}
+
+// whole lines of the file, see load_obj()
+typedef struct {
+        const char *begin;
+        const char *end;
+        int num_vertices;     // v and vt lines, counted by the first pass
+        int num_uvs;
+        int vertex_offset;    // v and vt lines in the chunks before this one
+        int uv_offset;
+        uint32_t *indices;    // dynamic arrays, 3 per triangle
+        uint32_t *uv_indices;
+        bool missing_uvs;
+        const char *error;    // the first error of the chunk, see obj_error()
+        const char *error_at;
+} obj_chunk_t;
+
+typedef struct {
+        obj_chunk_t *chunks;
+        vec3_t *vertices;     // every vertex and uv of the file, chunks write at their offset
+        tex2_t *uvs;
+} obj_parse_t;
+
+// first pass, the offsets of every chunk are known before any face is parsed,
+// so negative indices can be resolved right away
+static void count_obj_chunk(void *ctx, int chunk) {
+        obj_parse_t *parse = (obj_parse_t *)ctx;
+        obj_chunk_t *c = &parse->chunks[chunk];
+
+        obj_scanner_t s = { .p = c->begin, .end = c->end };
+        while (s.p < s.end) {
+                skip_spaces(&s);
+                if (scan_keyword(&s, "v")) c->num_vertices++;
+                else if (scan_keyword(&s, "vt")) c->num_uvs++;
+                next_line(&s);
+        }
 }
 
-void load_obj(char *file) {
-        FILE *fp = fopen(file, "r");
-        if (fp == NULL) {
+// second pass, faces can have any number of corners, polygons are split into a fan
+// around the first one, the chunk stops at its first error
+static void parse_obj_chunk(void *ctx, int chunk) {
+        obj_parse_t *parse = (obj_parse_t *)ctx;
+        obj_chunk_t *c = &parse->chunks[chunk];
+        vec3_t *vertices = &parse->vertices[c->vertex_offset];
+        tex2_t *uvs = &parse->uvs[c->uv_offset];
+        int num_vertices = 0;
+        int num_uvs = 0;
+
+        obj_scanner_t s = { .p = c->begin, .end = c->end };
+        while (s.p < s.end) {
+                skip_spaces(&s);
+                if (scan_keyword(&s, "v")) {
+                        // reading vertices
+                        vec3_t *vertex = &vertices[num_vertices++];
+                        if (!scan_float(&s, &vertex->x) || !scan_float(&s, &vertex->y) || !scan_float(&s, &vertex->z)) {
+                                obj_error(&s, "expected 3 vertex coordinates");
+                                break;
+                        }
+                } else if (scan_keyword(&s, "vt")) {
+                        tex2_t uv = { 0, 0 };
+                        if (!scan_float(&s, &uv.u)) {
+                                obj_error(&s, "expected a texture coordinate");
+                                break;
+                        }
+                        scan_float(&s, &uv.v);
+
+                        // NOTE(@k): some u,v float could slightly exceed 1.0, clamp it to 1.0
+                        //           vt 1.054287 0.431093
+                        float_clamp_inline(&uv.u, 0.0, 1.0);
+                        float_clamp_inline(&uv.v, 0.0, 1.0);
+                        uvs[num_uvs++] = uv;
+                } else if (scan_keyword(&s, "f")) {
+                        // reading faces, (first, previous, current) is the next triangle of the fan
+                        // TODO(@k): normal_indices
+                        int vertices_so_far = c->vertex_offset + num_vertices;
+                        int uvs_so_far = c->uv_offset + num_uvs;
+                        uint32_t first[2], previous[2], current[2];
+                        int corners = 0;
+                        for (skip_spaces(&s); !at_line_end(&s); skip_spaces(&s), corners++) {
+                                if (!scan_corner(&s, vertices_so_far, uvs_so_far, &current[0], &current[1])) break;
+                                if (current[1] == OBJ_NO_UV) c->missing_uvs = true;
+
+                                if (corners == 0) {
+                                        first[0] = current[0];
+                                        first[1] = current[1];
+                                } else if (corners >= 2) {
+                                        darray_push(c->indices, first[0]);
+                                        darray_push(c->indices, previous[0]);
+                                        darray_push(c->indices, current[0]);
+                                        darray_push(c->uv_indices, first[1]);
+                                        darray_push(c->uv_indices, previous[1]);
+                                        darray_push(c->uv_indices, current[1]);
+                                }
+                                previous[0] = current[0];
+                                previous[1] = current[1];
+                        }
+                        if (corners < 3 && s.error == NULL) obj_error(&s, "a face needs at least 3 corners");
+                }
+                // skip other line for now
+                next_line(&s);
+        }
+        c->error = s.error;
+        c->error_at = s.error_at;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// v, vt and f lines of a wavefront obj file, everything else is skipped
+// corners without a texture coordinate get uv (0, 0)
+// the chunks only depend on the file size, not on the number of threads, and are
+// put back together in file order, so the mesh is the same for any thread count
+// a file that can't be read or refers to data it doesn't have is reported, false is returned
+// and m is left as it was
+/////////////////////////////////////////////////////////////////////////////////////////
+static bool parse_obj(mesh_t *m, const char *file) {
+        file_view_t view;
+        if (!map_file(file, &view)) {
                 // TODO: the error can be identified more precisely
                 // see the discussion of error-handling functions at the end of
                 // Section 1 in Appendix B in clang edition 2
                 fprintf(stderr, "failed to open file %s\n", file);
-                exit(1);
+                return false;
         }
 
-        char line[MAX_LINE];
+        // split at the first line break after every chunk size
+        int num_chunks = (int)MIN(view.size / OBJ_MIN_CHUNK_SIZE, (size_t)jobs_num_threads() * OBJ_CHUNKS_PER_THREAD);
+        if (num_chunks < 1) num_chunks = 1;
+        obj_chunk_t *chunks = (obj_chunk_t *)calloc(num_chunks, sizeof(obj_chunk_t));
+        assert(chunks != NULL);
 
-        tex2_t *uvs = NULL;
-        while (fgets(line, MAX_LINE, fp)) {
-                int items;
-                if (strncmp(line, "v ", 2) == 0) {
-                        // reading vertices
-                        vec3_t vertex;
-                        items = sscanf(line + 2, "%f %f %f", &vertex.x,
-                                       &vertex.y, &vertex.z);
-                        assert(items == 3);
-                        darray_push(mesh.vertices, vertex);
-                } else if (strncmp(line, "vt ", 3) == 0) {
-                        tex2_t uv;
-                        sscanf(line + 3, "%f%f", &uv.u, &uv.v);
-                        darray_push(uvs, uv);
-                } else if (strncmp(line, "f ", 2) == 0) {
-                        // reading faces
-                        face_t face;
-                        int vertex_indices[3];
-                        int texture_uv_indices[3];
-                        // TODO(@k): normal_indices
+        const char *file_end = view.data + view.size;
+        const char *begin = view.data;
+        for (int i = 0; i < num_chunks; i++) {
+                const char *end = file_end;
+                if (i < num_chunks - 1) {
+                        end = view.data + view.size / num_chunks * (i + 1);
+                        if (end < begin) end = begin;
+                        const char *newline = memchr(end, '\n', file_end - end);
+                        end = newline ? newline + 1 : file_end;
+                }
+                chunks[i].begin = begin;
+                chunks[i].end = end;
+                begin = end;
+        }
 
-                        items = sscanf(line + 2,
-                                       "%d/%d/%*d %d/%d/%*d %d/%d/%*d",
-                                       &vertex_indices[0], &texture_uv_indices[0],
-                                       &vertex_indices[1], &texture_uv_indices[1],
-                                       &vertex_indices[2], &texture_uv_indices[2]);
+        obj_parse_t parse = { .chunks = chunks };
+        jobs_run(num_chunks, count_obj_chunk, &parse);
 
-                        assert(uvs != NULL);
-                        assert(items == 6);
+        int num_vertices = 0;
+        int num_uvs = 0;
+        for (int i = 0; i < num_chunks; i++) {
+                chunks[i].vertex_offset = num_vertices;
+                chunks[i].uv_offset = num_uvs;
+                num_vertices += chunks[i].num_vertices;
+                num_uvs += chunks[i].num_uvs;
+        }
 
-                        face.a = vertex_indices[0];
-                        face.b = vertex_indices[1];
-                        face.c = vertex_indices[2];
+        // one more uv for corners without one
+        parse.vertices = (vec3_t *)malloc(sizeof(vec3_t) * (num_vertices + 1));
+        parse.uvs = (tex2_t *)malloc(sizeof(tex2_t) * (num_uvs + 1));
+        assert(parse.vertices != NULL && parse.uvs != NULL);
+        jobs_run(num_chunks, parse_obj_chunk, &parse);
 
-                        face.a_uv = uvs[texture_uv_indices[0] - 1];
-                        face.b_uv = uvs[texture_uv_indices[1] - 1];
-                        face.c_uv = uvs[texture_uv_indices[2] - 1];
+        // the first error in file order is reported, the line is counted here instead of in the job
+        bool ok = true;
+        for (int i = 0; i < num_chunks && ok; i++) {
+                if (chunks[i].error == NULL) continue;
+                int line = 1;
+                for (const char *c = view.data; c < chunks[i].error_at; c++) line += *c == '\n';
+                fprintf(stderr, "%s:%d: %s\n", file, line, chunks[i].error);
+                ok = false;
+        }
+        unmap_file(&view);
 
-                        // NOTE(@k): some u,v float could slightly exceed 1.0, clamp it to 1.0
-                        //           vt 1.054287 0.431093
-                        if (face.a_uv.u > 1.0) face.a_uv.u = 1.0;
-                        float_clamp_inline(&face.a_uv.u, 0.0, 1.0);
-                        float_clamp_inline(&face.a_uv.v, 0.0, 1.0);
-                        float_clamp_inline(&face.b_uv.u, 0.0, 1.0);
-                        float_clamp_inline(&face.b_uv.v, 0.0, 1.0);
-                        float_clamp_inline(&face.c_uv.u, 0.0, 1.0);
-                        float_clamp_inline(&face.c_uv.v, 0.0, 1.0);
-
-                        // TODO(@k): make it configable
-                        face.color = 0xFFFFFFFF;
-                        darray_push(mesh.faces, face);
-                } else {
-                        // skip other line for now
-                        continue;
+        // put the faces of the chunks back together
+        int num_indices = 0;
+        bool missing_uvs = false;
+        for (int i = 0; i < num_chunks; i++) {
+                num_indices += darray_size(chunks[i].indices);
+                missing_uvs |= chunks[i].missing_uvs;
+        }
+
+        uint32_t *indices = (uint32_t *)malloc(sizeof(uint32_t) * (num_indices + 1));
+        uint32_t *uv_indices = (uint32_t *)malloc(sizeof(uint32_t) * (num_indices + 1));
+        assert(indices != NULL && uv_indices != NULL);
+        int n = 0;
+        for (int i = 0; i < num_chunks; i++) {
+                int count = darray_size(chunks[i].indices);
+                if (count > 0) {
+                        memcpy(&indices[n], chunks[i].indices, sizeof(uint32_t) * count);
+                        memcpy(&uv_indices[n], chunks[i].uv_indices, sizeof(uint32_t) * count);
+                }
+                n += count;
+                darray_free(chunks[i].indices);
+                darray_free(chunks[i].uv_indices);
+        }
+        free(chunks);
+
+        // corners without a texture coordinate share one extra uv
+        if (missing_uvs) {
+                parse.uvs[num_uvs] = (tex2_t){ 0, 0 };
+                for (int i = 0; i < num_indices; i++) {
+                        if (uv_indices[i] == OBJ_NO_UV) uv_indices[i] = num_uvs;
+                }
+                num_uvs++;
+        }
+
+        for (int i = 0; i < num_indices && ok; i++) {
+                if (indices[i] >= (uint32_t)num_vertices || uv_indices[i] >= (uint32_t)num_uvs) {
+                        fprintf(stderr, "%s: face %d refers to a vertex or texture coordinate that doesn't exist\n", file, i / 3 + 1);
+                        ok = false;
                 }
         }
 
-        if (uvs != NULL) darray_free(uvs);
+        // TODO(@k): make it configable
+        if (ok) {
+                build_mesh(m, parse.vertices, num_vertices, parse.uvs, num_uvs,
+                           indices, uv_indices, num_indices / 3, 0xFFFFFFFF);
+        }
+
+        free(parse.vertices);
+        free(parse.uvs);
+        free(indices);
+        free(uv_indices);
+        return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// mesh cache
+// the arrays of a parsed obj file are saved next to it exactly as build_mesh() lays them
+// out in memory, a later load maps the file and points the mesh into it, nothing is parsed
+// or copied, the cache is used as long as size and modification time (nanoseconds) of the obj
+// match, every index is checked against num_vertices and num_uvs before the mesh points into it
+// same byte order and float format only, a cache from another machine is rebuilt
+/////////////////////////////////////////////////////////////////////////////////////////
+#define MESH_CACHE_VERSION 2
+#define MESH_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct {
+        char magic[4];         // "MESH"
+        uint32_t version;
+        uint32_t byte_order;   // MESH_CACHE_BYTE_ORDER as written by this machine
+        uint32_t index_size;
+        uint64_t source_size;  // of the obj file
+        int64_t source_mtime;  // nanoseconds
+        uint64_t file_size;    // of the cache file itself
+        uint32_t num_vertices;
+        uint32_t num_uvs;
+        uint32_t num_faces;
+        uint32_t color;
+        float bounds_min[3];
+        float bounds_max[3];
+        uint64_t offsets[6];   // x, y, z, uvs, indices and uv_indices from the start of the file, ARENA_ALIGNMENT aligned
+} mesh_cache_header_t;
+
+// bytes of the arrays in the order of mesh_cache_header_t.offsets
+static void mesh_cache_sizes(const mesh_cache_header_t *h, uint64_t sizes[6]) {
+        sizes[0] = sizes[1] = sizes[2] = (uint64_t)sizeof(float) * h->num_vertices;
+        sizes[3] = (uint64_t)sizeof(tex2_t) * h->num_uvs;
+        sizes[4] = sizes[5] = (uint64_t)h->index_size * h->num_faces * 3;
+}
+
+static uint64_t cache_align(uint64_t n) {
+        return (n + ARENA_ALIGNMENT - 1) & ~(uint64_t)(ARENA_ALIGNMENT - 1);
+}
+
+// false when any of the count indices is limit or more
+static bool indices_in_range(const void *indices, int index_size, uint64_t count, uint32_t limit) {
+        uint32_t max = 0;
+        if (index_size == 2) {
+                const uint16_t *p = (const uint16_t *)indices;
+                for (uint64_t i = 0; i < count; i++) max = MAX(max, p[i]);
+        } else {
+                const uint32_t *p = (const uint32_t *)indices;
+                for (uint64_t i = 0; i < count; i++) max = MAX(max, p[i]);
+        }
+        return count == 0 || max < limit;
+}
+
+static void mesh_cache_path(const char *file, char *path, size_t size) {
+        snprintf(path, size, "%s.mesh", file);
+}
+
+static bool load_mesh_cache(mesh_t *m, const char *file) {
+        uint64_t source_size;
+        int64_t source_mtime;
+        if (!file_info(file, &source_size, &source_mtime)) return false;
+
+        char path[4096];
+        mesh_cache_path(file, path, sizeof(path));
+        file_view_t view;
+        if (!map_file(path, &view)) return false;
+
+        // anything that doesn't match exactly means the cache is stale or not ours
+        const mesh_cache_header_t *h = (const mesh_cache_header_t *)view.data;
+        bool ok = view.size >= sizeof(*h) && memcmp(h->magic, "MESH", 4) == 0 &&
+                  h->version == MESH_CACHE_VERSION && h->byte_order == MESH_CACHE_BYTE_ORDER &&
+                  (h->index_size == 2 || h->index_size == 4) &&
+                  h->source_size == source_size && h->source_mtime == source_mtime && h->file_size == view.size &&
+                  h->num_vertices <= INT32_MAX && h->num_uvs <= INT32_MAX && h->num_faces <= INT32_MAX / 3;
+        if (ok) {
+                uint64_t sizes[6];
+                mesh_cache_sizes(h, sizes);
+                for (int i = 0; i < 6; i++) {
+                        if (h->offsets[i] % ARENA_ALIGNMENT != 0 || h->offsets[i] > view.size || sizes[i] > view.size - h->offsets[i]) ok = false;
+                }
+        }
+
+        // a header that matches with indices out of range is a damaged file, not a stale one
+        if (ok) {
+                uint64_t num_indices = (uint64_t)h->num_faces * 3;
+                ok = indices_in_range(view.data + h->offsets[4], h->index_size, num_indices, h->num_vertices) &&
+                     indices_in_range(view.data + h->offsets[5], h->index_size, num_indices, h->num_uvs);
+                if (!ok) fprintf(stderr, "the mesh cache of %s has indices out of range, parsing the obj\n", file);
+        }
+        if (!ok) {
+                unmap_file(&view);
+                return false;
+        }
+
+        destroy_mesh(m);
+        m->cache = view;
+        m->x = (float *)(view.data + h->offsets[0]);
+        m->y = (float *)(view.data + h->offsets[1]);
+        m->z = (float *)(view.data + h->offsets[2]);
+        m->uvs = (tex2_t *)(view.data + h->offsets[3]);
+        m->indices = (void *)(view.data + h->offsets[4]);
+        m->uv_indices = (void *)(view.data + h->offsets[5]);
+        m->num_vertices = h->num_vertices;
+        m->num_uvs = h->num_uvs;
+        m->num_faces = h->num_faces;
+        m->index_size = h->index_size;
+        m->color = h->color;
+        m->bounds_min = (vec3_t){ h->bounds_min[0], h->bounds_min[1], h->bounds_min[2] };
+        m->bounds_max = (vec3_t){ h->bounds_max[0], h->bounds_max[1], h->bounds_max[2] };
+        return true;
+}
+
+// written to a temporary file first, a crash never leaves a half written cache behind
+static bool write_mesh_cache(const mesh_t *m, const char *file) {
+        mesh_cache_header_t h = {
+                .magic = { 'M', 'E', 'S', 'H' },
+                .version = MESH_CACHE_VERSION,
+                .byte_order = MESH_CACHE_BYTE_ORDER,
+                .index_size = m->index_size,
+                .num_vertices = m->num_vertices,
+                .num_uvs = m->num_uvs,
+                .num_faces = m->num_faces,
+                .color = m->color,
+                .bounds_min = { m->bounds_min.x, m->bounds_min.y, m->bounds_min.z },
+                .bounds_max = { m->bounds_max.x, m->bounds_max.y, m->bounds_max.z },
+        };
+        if (!file_info(file, &h.source_size, &h.source_mtime)) return false;
+
+        const void *arrays[6] = { m->x, m->y, m->z, m->uvs, m->indices, m->uv_indices };
+        uint64_t sizes[6];
+        mesh_cache_sizes(&h, sizes);
+        uint64_t offset = cache_align(sizeof(h));
+        for (int i = 0; i < 6; i++) {
+                h.offsets[i] = offset;
+                offset = cache_align(offset + sizes[i]);
+        }
+        h.file_size = offset;
+
+        char path[4096];
+        char tmp_path[4096 + 4];
+        mesh_cache_path(file, path, sizeof(path));
+        snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+        FILE *fp = fopen(tmp_path, "wb");
+        if (!fp) return false;
+
+        // every array starts at its offset, the gaps are zeros
+        static const char padding[ARENA_ALIGNMENT] = {0};
+        uint64_t written = fwrite(&h, 1, sizeof(h), fp);
+        for (int i = 0; i < 6; i++) {
+                written += fwrite(padding, 1, h.offsets[i] - written, fp);
+                if (sizes[i] > 0) written += fwrite(arrays[i], 1, sizes[i], fp);
+        }
+        written += fwrite(padding, 1, h.file_size - written, fp);
+
+        bool ok = written == h.file_size && !ferror(fp);
+        if (fclose(fp) != 0) ok = false;
+        if (ok) ok = rename(tmp_path, path) == 0;
+        if (!ok) remove(tmp_path);
+        return ok;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// parse an obj file into m, or map the cache file of an earlier parse when it is still up
+// to date, only the data of m is replaced
+// doesn't touch the global mesh, so it can run on a loader thread while frames
+// are rendered, see loader.c
+// false when the file can't be parsed, m is left as it was then
+/////////////////////////////////////////////////////////////////////////////////////////
+bool load_obj_into(mesh_t *m, const char *file) {
+        if (load_mesh_cache(m, file)) return true;
+
+        if (!parse_obj(m, file)) return false;
+        // not fatal, e.g. a read-only assets directory just means parsing every time
+        if (!write_mesh_cache(m, file)) fprintf(stderr, "failed to write the mesh cache of %s\n", file);
+        return true;
+}
+
+// false when the file can't be parsed, the global mesh stays as it is then
+bool load_obj(char *file) {
+        mesh_t loaded = {0};
+        if (!load_obj_into(&loaded, file)) return false;
+        replace_mesh(&loaded);
+        return true;
 }
 
 // TODO(@k): try to eliminate global variables
 // initialize the global mesh
 mesh_t mesh = {
-        .faces       = NULL,
-        .vertices    = NULL,
         .rotation    = {  0,   0,   0},
         .translation = {  0,   0,   0},
         .scale       = {1.0, 1.0, 1.0},
@@ -1,6 +1,10 @@
 #ifndef MESH_H
 #define MESH_H
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
 #include "triangle.h"
+#include "util.h"
 #include "vector.h"
 
 #define N_CUBE_VERTICES 8
@@ -10,16 +14,52 @@ extern vec3_t cube_vertices[N_CUBE_VERTICES];
 // basically the vertices index
 extern face_t cube_faces[N_CUBE_FACES];
 
+/*
+ * structure of arrays, so the transform stage can load 4 or 8 coordinates at once
+ * faces only store indices, the uvs are shared by every face corner that uses them
+ * indices are 0-based, 16 bit when every vertex and uv fits, 32 bit otherwise,
+ * read them with mesh_vertex_index() and mesh_uv_index()
+ * a mesh loaded from a cache file points straight into the read-only mapping,
+ * the arrays are never written after loading
+ */
 typedef struct {
-        vec3_t *vertices;     // dynamic array of vertices
-        face_t *faces;        // dynamic array of faces
+        float *x;             // positions, ARENA_ALIGNMENT aligned
+        float *y;
+        float *z;
+        int num_vertices;
+        tex2_t *uvs;
+        int num_uvs;
+        void *indices;        // 3 per face, into x, y and z
+        void *uv_indices;     // 3 per face, into uvs
+        int index_size;       // bytes per index, 2 or 4
+        int num_faces;
+        uint32_t color;       // every face has the same solid color
+        vec3_t bounds_min;    // model space bounding box of the positions
+        vec3_t bounds_max;
         vec3_t rotation;      // rotation with x, y and z values
         vec3_t scale;         // scale with x, y, and z values
         vec3_t translation;   // translation with x, y and z values
         // position           // word position for example
+        arena_t storage;      // owns every array above
+        file_view_t cache;    // or the cache file they are mapped from, see load_obj()
 } mesh_t;
 
+// corner k of face f
+static inline uint32_t mesh_vertex_index(const mesh_t *m, int f, int k) {
+        int i = 3 * f + k;
+        return m->index_size == 2 ? ((const uint16_t *)m->indices)[i] : ((const uint32_t *)m->indices)[i];
+}
+
+static inline uint32_t mesh_uv_index(const mesh_t *m, int f, int k) {
+        int i = 3 * f + k;
+        return m->index_size == 2 ? ((const uint16_t *)m->uv_indices)[i] : ((const uint32_t *)m->uv_indices)[i];
+}
+
 extern mesh_t mesh;
 void load_cube_mesh_data(void);
-void load_obj(char *file);
+bool load_obj(char *file);
+bool load_obj_into(mesh_t *m, const char *file);
+void replace_mesh(mesh_t *loaded);
+void destroy_mesh(mesh_t *m);
+void free_mesh(void);
 #endif
@@ -0,0 +1,105 @@
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include "prof.h"
+
+const char *prof_stage_names[PROF_STAGE_COUNT] = {
+        [PROF_INPUT] = "input",
+        [PROF_TRANSFORM] = "transform",
+        [PROF_CULL] = "cull",
+        [PROF_CLIP] = "clip",
+        [PROF_VIEWPORT] = "viewport",
+        [PROF_RASTER] = "raster",
+        [PROF_GRID] = "grid",
+        [PROF_HUD] = "hud",
+        [PROF_CLEAR] = "clear",
+        [PROF_PRESENT] = "present",
+        [PROF_FRAME] = "frame",
+};
+
+// swatch colors of the hud, RGBA32 like the color buffer
+const uint32_t prof_stage_colors[PROF_STAGE_COUNT] = {
+        [PROF_INPUT] = 0xFF808080,
+        [PROF_TRANSFORM] = 0xFF3030E0,
+        [PROF_CULL] = 0xFF30A0F0,
+        [PROF_CLIP] = 0xFF30E0E0,
+        [PROF_VIEWPORT] = 0xFF30E030,
+        [PROF_RASTER] = 0xFFE07030,
+        [PROF_GRID] = 0xFF93BDAE,
+        [PROF_HUD] = 0xFFE030E0,
+        [PROF_CLEAR] = 0xFF6060A0,
+        [PROF_PRESENT] = 0xFFF0F0F0,
+        [PROF_FRAME] = 0xFF00FF00,
+};
+
+static uint64_t frame_start = 0;
+static uint64_t current[PROF_STAGE_COUNT];
+static uint64_t history[PROF_HISTORY][PROF_STAGE_COUNT];
+static uint64_t history_sum[PROF_STAGE_COUNT];
+static int history_next = 0;
+static int history_size = 0;
+static int frame_number = 0;
+static FILE *csv = NULL;
+
+uint64_t prof_now(void) {
+        return SDL_GetPerformanceCounter();
+}
+
+void prof_begin_frame(void) {
+        for (int i = 0; i < PROF_STAGE_COUNT; i++) current[i] = 0;
+        frame_start = prof_now();
+}
+
+void prof_add(enum prof_stage stage, uint64_t ticks) {
+        current[stage] += ticks;
+}
+
+void prof_end_frame(void) {
+        current[PROF_FRAME] = prof_now() - frame_start;
+
+        // replace the oldest frame of the window
+        for (int i = 0; i < PROF_STAGE_COUNT; i++) {
+                history_sum[i] += current[i] - history[history_next][i];
+                history[history_next][i] = current[i];
+        }
+        history_next = (history_next + 1) % PROF_HISTORY;
+        if (history_size < PROF_HISTORY) history_size++;
+
+        if (csv) {
+                double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+                fprintf(csv, "%d", frame_number);
+                for (int i = 0; i < PROF_STAGE_COUNT; i++) fprintf(csv, ",%.4f", current[i] * ms_per_tick);
+                fprintf(csv, "\n");
+        }
+        frame_number++;
+}
+
+// microseconds, averaged over the last PROF_HISTORY frames
+int prof_average_us(enum prof_stage stage) {
+        if (history_size == 0) return 0;
+        return (int)(history_sum[stage] * 1000000.0 / SDL_GetPerformanceFrequency() / history_size);
+}
+
+// one row per frame from now on, milliseconds per stage
+bool prof_csv_open(const char *path) {
+        prof_csv_close();
+
+        csv = fopen(path, "w");
+        if (!csv) {
+                fprintf(stderr, "failed to open file %s\n", path);
+                return false;
+        }
+
+        fprintf(csv, "frame");
+        for (int i = 0; i < PROF_STAGE_COUNT; i++) fprintf(csv, ",%s_ms", prof_stage_names[i]);
+        fprintf(csv, "\n");
+        return true;
+}
+
+void prof_csv_close(void) {
+        if (csv) fclose(csv);
+        csv = NULL;
+}
+
+bool prof_csv_is_open(void) {
+        return csv != NULL;
+}
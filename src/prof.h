@@ -0,0 +1,39 @@
+#ifndef PROF_H
+#define PROF_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * per-stage frame profiler
+ * every frame collects the time of each pipeline stage, the last PROF_HISTORY frames
+ * are kept for rolling averages and every frame can be appended to a csv file
+ */
+enum prof_stage {
+        PROF_INPUT,
+        PROF_TRANSFORM,
+        PROF_CULL,
+        PROF_CLIP,
+        PROF_VIEWPORT,
+        PROF_RASTER,
+        PROF_GRID,
+        PROF_HUD,
+        PROF_CLEAR,
+        PROF_PRESENT,
+        PROF_FRAME, // the whole frame, including the parts no stage accounts for
+        PROF_STAGE_COUNT,
+};
+
+#define PROF_HISTORY 32
+
+extern const char *prof_stage_names[PROF_STAGE_COUNT];
+extern const uint32_t prof_stage_colors[PROF_STAGE_COUNT];
+
+uint64_t prof_now(void);
+void prof_begin_frame(void);
+void prof_add(enum prof_stage stage, uint64_t ticks);
+void prof_end_frame(void);
+int prof_average_us(enum prof_stage stage);
+bool prof_csv_open(const char *path);
+void prof_csv_close(void);
+bool prof_csv_is_open(void);
+#endif
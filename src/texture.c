@@ -1,13 +1,19 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include "texture.h"
+#include "upng.h"
+#include "util.h"
 
 // TODO(@k): global mesh_texture for now
 uint32_t *mesh_texture = NULL;
-upng_t *upng = NULL;
 int texture_width = 64;
 int texture_height = 64;
+mip_level_t mesh_mips[MAX_MIP_LEVELS];
+int num_mesh_mips = 0;
 
 const uint8_t REDBRICK_TEXTURE[] = {
     0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff, 0x38, 0x38, 0x38, 0xff,
@@ -76,14 +82,206 @@ const uint8_t REDBRICK_TEXTURE[] = {
     0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff, 0x54, 0x54, 0x54, 0xff,
 };
 
-void load_png_texture(char *file) {
-        upng = upng_new_from_file(file);
-        assert(upng != NULL);
+static void generate_mips(mip_level_t *mips, int *num_mips, uint32_t *texels, int width, int height);
+static void free_mips(mip_level_t *mips, int *num_mips);
 
-        upng_decode(upng);
-        assert(upng_get_error(upng) == UPNG_EOK);
+// texels of a width x height level in tiles, padding included
+static size_t tiled_size(int width, int height) {
+        size_t tiles_x = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        size_t tiles_y = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        return tiles_x * tiles_y * TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the row-major image at the start of texels into tiles, in place, the buffer holds tiled_size()
+// one row of tiles is copied out at a time, the last one first: row ty of tiles ends at or after
+// the end of the image rows it's made of, so it never overwrites rows that weren't copied yet
+/////////////////////////////////////////////////////////////////////////////////////////
+static void tile_texels(uint32_t *texels, int width, int height) {
+        int tiles_x = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        int tiles_y = (height + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        uint32_t *rows = (uint32_t *)malloc(sizeof(uint32_t) * width * TEXTURE_TILE_SIZE);
+        assert(rows != NULL);
+
+        for (int ty = tiles_y - 1; ty >= 0; ty--) {
+                int y0 = ty * TEXTURE_TILE_SIZE;
+                int num_rows = MIN(TEXTURE_TILE_SIZE, height - y0);
+                memcpy(rows, &texels[width * y0], sizeof(uint32_t) * width * num_rows);
+
+                // the padding right of and below the image stays 0
+                for (int y = 0; y < TEXTURE_TILE_SIZE; y++) {
+                        for (int x = 0; x < tiles_x * TEXTURE_TILE_SIZE; x++) {
+                                uint32_t texel = (y < num_rows && x < width) ? rows[width * y + x] : 0;
+                                texels[texture_tiled_index(x, y0 + y, tiles_x)] = texel;
+                        }
+                }
+        }
+        free(rows);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// decode a png straight into the texel buffer of t, the decoder is gone before the mips are built
+// the file contents and the texels are the only big allocations, the scanlines are inflated into
+// the end of the texel buffer and unfiltered towards its start, 8 bit RGB files are expanded to
+// RGBA on the way, then the rows are put into tiles in the same buffer
+// the file is freed before the mips are built, they add a third of the texels, so the peak is
+// the file and the texels while decoding, for crab.png 1.58 MB, 1.40 MB stay with the mips
+// doesn't touch the global texture, so it can run on a loader thread while frames are rendered,
+// see loader.c, a file that can't be decoded is reported and t is left as it was
+/////////////////////////////////////////////////////////////////////////////////////////
+bool load_png_texture_into(texture_t *t, const char *file) {
+        upng_t *png = upng_new_from_file(file);
+        if (png == NULL) {
+                fprintf(stderr, "%s: out of memory\n", file);
+                return false;
+        }
+
+        // only 8 bit RGB and RGBA files have an rgba8 size
+        upng_header(png);
+        if (upng_get_error(png) != UPNG_EOK || upng_get_rgba8_size(png) == 0) {
+                fprintf(stderr, "%s: can't load the png, upng error %d\n", file, upng_get_error(png));
+                upng_free(png);
+                return false;
+        }
+
+        // for RGBA the decoder needs one byte per row more than the image, the filter types,
+        // the tiles need the padding to a multiple of 4 texels in both directions
+        int width = upng_get_width(png);
+        int height = upng_get_height(png);
+        size_t size = MAX(upng_get_rgba8_size(png), tiled_size(width, height) * sizeof(uint32_t));
+        uint8_t *texels = (uint8_t *)malloc(size);
+        if (texels == NULL || upng_decode_rgba8_into(png, texels, size) != UPNG_EOK) {
+                fprintf(stderr, "%s: can't load the png, upng error %d\n", file, texels ? upng_get_error(png) : UPNG_ENOMEM);
+                free(texels);
+                upng_free(png);
+                return false;
+        }
+        upng_free(png);
+
+        tile_texels((uint32_t *)texels, width, height);
+
+        free_texture(t);
+        t->texels = (uint32_t *)texels;
+        t->width = width;
+        t->height = height;
+
+        generate_mips(t->mips, &t->num_mips, t->texels, t->width, t->height);
+        return true;
+}
+
+// the hardcoded 64x64 red brick texture, for meshes that come without a png
+void load_redbrick_texture_into(texture_t *t) {
+        uint32_t *texels = (uint32_t *)malloc(sizeof(uint32_t) * tiled_size(64, 64));
+        assert(texels != NULL);
+        memcpy(texels, REDBRICK_TEXTURE, sizeof(uint32_t) * 64 * 64);
+        tile_texels(texels, 64, 64);
+
+        free_texture(t);
+        t->texels = texels;
+        t->width = 64;
+        t->height = 64;
+
+        generate_mips(t->mips, &t->num_mips, t->texels, t->width, t->height);
+}
+
+// false when the file can't be decoded, the global texture stays as it is then
+bool load_png_texture(char *file) {
+        texture_t loaded = {0};
+        if (!load_png_texture_into(&loaded, file)) return false;
+        replace_texture(&loaded);
+        return true;
+}
+
+void load_redbrick_texture(void) {
+        texture_t loaded = {0};
+        load_redbrick_texture_into(&loaded);
+        replace_texture(&loaded);
+}
+
+// average of a 2x2 texel footprint, every 8 bit channel on its own
+static uint32_t box_filter(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+        uint32_t ret = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+                uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) + ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+                ret |= ((sum + 2) / 4) << shift;
+        }
+        return ret;
+}
+
+static void downsample_mip(const mip_level_t *src, mip_level_t *dst) {
+        dst->width = MAX(src->width / 2, 1);
+        dst->height = MAX(src->height / 2, 1);
+        dst->tiles_x = (dst->width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        dst->texels = (uint32_t *)calloc(tiled_size(dst->width, dst->height), sizeof(uint32_t));
+        assert(dst->texels != NULL);
+
+        for (int y = 0; y < dst->height; y++) {
+                // a side of size 1 can't be halved, the footprint reuses the same texel
+                int y0 = MIN(y * 2, src->height - 1);
+                int y1 = MIN(y * 2 + 1, src->height - 1);
+                for (int x = 0; x < dst->width; x++) {
+                        int x0 = MIN(x * 2, src->width - 1);
+                        int x1 = MIN(x * 2 + 1, src->width - 1);
+                        dst->texels[texture_tiled_index(x, y, dst->tiles_x)] = box_filter(
+                                src->texels[texture_tiled_index(x0, y0, src->tiles_x)],
+                                src->texels[texture_tiled_index(x1, y0, src->tiles_x)],
+                                src->texels[texture_tiled_index(x0, y1, src->tiles_x)],
+                                src->texels[texture_tiled_index(x1, y1, src->tiles_x)]
+                        );
+                }
+        }
+}
+
+static void free_mips(mip_level_t *mips, int *num_mips) {
+        for (int i = 1; i < *num_mips; i++) free(mips[i].texels);
+        *num_mips = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// mip chain of the tiled texels down to 1x1, 2x2 box filter per level
+// level 0 shares the memory of texels, the other levels are owned by the chain
+/////////////////////////////////////////////////////////////////////////////////////////
+static void generate_mips(mip_level_t *mips, int *num_mips, uint32_t *texels, int width, int height) {
+        free_mips(mips, num_mips);
+
+        mips[0].texels = texels;
+        mips[0].width = width;
+        mips[0].height = height;
+        mips[0].tiles_x = (width + TEXTURE_TILE_SIZE - 1) / TEXTURE_TILE_SIZE;
+        *num_mips = 1;
+
+        while (*num_mips < MAX_MIP_LEVELS) {
+                mip_level_t *last = &mips[*num_mips - 1];
+                if (last->width == 1 && last->height == 1) break;
+                downsample_mip(last, &mips[*num_mips]);
+                (*num_mips)++;
+        }
+}
+
+void free_texture(texture_t *t) {
+        free_mips(t->mips, &t->num_mips);
+        free(t->texels);
+        t->texels = NULL;
+}
+
+void free_png_texture(void) {
+        free_mips(mesh_mips, &num_mesh_mips);
+
+        free(mesh_texture);
+        mesh_texture = NULL;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// the global texture takes over loaded, its own texels and mips are freed, loaded is left empty
+/////////////////////////////////////////////////////////////////////////////////////////
+void replace_texture(texture_t *loaded) {
+        free_png_texture();
+
+        mesh_texture = loaded->texels;
+        texture_width = loaded->width;
+        texture_height = loaded->height;
+        for (int i = 0; i < loaded->num_mips; i++) mesh_mips[i] = loaded->mips[i];
+        num_mesh_mips = loaded->num_mips;
 
-        mesh_texture = (uint32_t *)upng_get_buffer(upng);
-        texture_width = upng_get_width(upng);
-        texture_height = upng_get_height(upng);
+        *loaded = (texture_t){0};
 }
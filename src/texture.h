@@ -1,18 +1,58 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
+#include <stdbool.h>
 #include <stdint.h>
-#include "upng.h"
 typedef struct {
         float u;
         float v;
 } tex2_t;
 
+// one level of a mip chain, each level is half the size of the previous one
+// the texels are in 4x4 tiles, see texture_tiled_index()
+typedef struct {
+        uint32_t *texels;
+        int width;
+        int height;
+        int tiles_x; // tiles per row of tiles
+} mip_level_t;
+
+#define TEXTURE_TILE_SIZE 4
+
+/*
+ * index of texel (x, y) in a level of tiles_x tiles per row: the tiles are stored row by row
+ * and the 16 texels of a tile in z-order, so a tile is one 64 byte cache line and a step in
+ * either direction mostly stays inside it, levels are padded to a multiple of the tile size
+ */
+static inline uint32_t texture_tiled_index(uint32_t x, uint32_t y, uint32_t tiles_x) {
+        uint32_t in_tile = (x & 1) | ((y & 1) << 1) | ((x & 2) << 1) | ((y & 2) << 2);
+        return (((y >> 2) * tiles_x + (x >> 2)) << 4) | in_tile;
+}
+
+#define MAX_MIP_LEVELS 16
+
+// a texture with its mip chain, see load_png_texture_into()
+typedef struct {
+        uint32_t *texels;
+        int width;
+        int height;
+        mip_level_t mips[MAX_MIP_LEVELS]; // level 0 is texels itself
+        int num_mips;
+} texture_t;
+
 // TODO(@k): Global texture for now
 extern int texture_width;
 extern int texture_height;
 extern const uint8_t REDBRICK_TEXTURE[];
 extern uint32_t *mesh_texture;
-extern upng_t *upng;
+extern mip_level_t mesh_mips[MAX_MIP_LEVELS]; // level 0 is mesh_texture itself
+extern int num_mesh_mips;
+
+bool load_png_texture(char *file);
+void load_redbrick_texture(void);
+void free_png_texture(void);
 
-void load_png_texture(char *file);
+bool load_png_texture_into(texture_t *t, const char *file);
+void load_redbrick_texture_into(texture_t *t);
+void replace_texture(texture_t *loaded);
+void free_texture(texture_t *t);
 #endif
@@ -0,0 +1,79 @@
+#include <math.h>
+#include <stddef.h>
+#include "triangle.h"
+#include "util.h"
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// t is in screen space already: x and y in pixels, z divided by w, w still the one of clip space
+// the level of detail is picked from the uv derivatives of the whole triangle, texels per
+// pixel along a side is sqrt(texel area / pixel area), the nearest level brings it to ~1
+// uv is NULL when the triangle won't be textured, mips can be NULL too then
+/////////////////////////////////////////////////////////////////////////////////////////
+// edge functions at the origin of the attribute planes and their steps per pixel, the same
+// ones setup_edge_triangle() in display.c computes, so the planes interpolate exactly the
+// values the rasterizer would have set up itself
+typedef struct {
+        int64_t e[3];
+        int64_t e_dx[3];
+        int64_t e_dy[3];
+        double inv_area;
+} plane_weights_t;
+
+// plane through the attribute values fa, fb and fc at the vertices A, B and C
+static raster_plane_t setup_plane(const plane_weights_t *w, double fa, double fb, double fc) {
+        raster_plane_t p;
+        p.value = (fa * w->e[0] + fb * w->e[1] + fc * w->e[2]) * w->inv_area;
+        p.dx = (fa * w->e_dx[0] + fb * w->e_dx[1] + fc * w->e_dx[2]) * w->inv_area;
+        p.dy = (fa * w->e_dy[0] + fb * w->e_dy[1] + fc * w->e_dy[2]) * w->inv_area;
+        return p;
+}
+
+void raster_triangle_setup(const triangle_t *t, const mip_level_t *mips, int num_mips, raster_triangle_t *r, raster_texcoords_t *uv) {
+        for (int i = 0; i < 3; i++) {
+                r->x[i] = lrintf(t->points[i].x * SUBPIXEL_ONE);
+                r->y[i] = lrintf(t->points[i].y * SUBPIXEL_ONE);
+                r->z[i] = t->points[i].z;
+        }
+        r->color = t->color;
+        if (uv == NULL) return;
+
+        *uv = (raster_texcoords_t){ .lod = 0 };
+
+        // twice the pixel area in subpixels, either winding is drawn, degenerate ones are not
+        int64_t xs[3] = { r->x[0], r->x[1], r->x[2] };
+        int64_t ys[3] = { r->y[0], r->y[1], r->y[2] };
+        int64_t area = (ys[2] - ys[0]) * (xs[1] - xs[0]) - (xs[2] - xs[0]) * (ys[1] - ys[0]);
+        if (area == 0) return;
+        int64_t orientation = area > 0 ? 1 : -1;
+        area *= orientation;
+
+        // anchored at the top-left pixel of the bounding box, edges turned around for clockwise triangles
+        plane_weights_t w;
+        int64_t ox = ((MIN(MIN(xs[0], xs[1]), xs[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS) << SUBPIXEL_BITS;
+        int64_t oy = ((MIN(MIN(ys[0], ys[1]), ys[2]) + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS) << SUBPIXEL_BITS;
+        for (int i = 0; i < 3; i++) {
+                int j = (i + 1) % 3;
+                int k = (i + 2) % 3;
+                int64_t dx = (xs[k] - xs[j]) * orientation;
+                int64_t dy = (ys[k] - ys[j]) * orientation;
+                w.e[i] = (oy - ys[j]) * dx - (ox - xs[j]) * dy;
+                w.e_dx[i] = -dy * SUBPIXEL_ONE;
+                w.e_dy[i] = dx * SUBPIXEL_ONE;
+        }
+        w.inv_area = 1.0 / area;
+
+        double inv_w[3] = { 1.0 / t->points[0].w, 1.0 / t->points[1].w, 1.0 / t->points[2].w };
+        const tex2_t *tc = t->texcoords;
+        uv->inv_w = setup_plane(&w, inv_w[0], inv_w[1], inv_w[2]);
+        uv->u_w = setup_plane(&w, tc[0].u * inv_w[0], tc[1].u * inv_w[1], tc[2].u * inv_w[2]);
+        uv->v_w = setup_plane(&w, tc[0].v * inv_w[0], tc[1].v * inv_w[1], tc[2].v * inv_w[2]);
+
+        if (mips == NULL || num_mips <= 1) return;
+
+        double uv_area = fabs((tc[1].u - tc[0].u) * (tc[2].v - tc[0].v) - (tc[2].u - tc[0].u) * (tc[1].v - tc[0].v));
+        double texels_per_pixel = uv_area * mips[0].width * mips[0].height * (1.0 / area) * SUBPIXEL_ONE * SUBPIXEL_ONE;
+        if (texels_per_pixel > 1.0) {
+                int lod = (int)floor(0.5 * log2(texels_per_pixel) + 0.5);
+                uv->lod = MIN(lod, num_mips - 1);
+        }
+}
@@ -20,4 +20,41 @@ typedef struct {
         tex2_t texcoords[3];
         uint32_t color;
 } triangle_t;
+
+// screen positions handed to the rasterizer are fixed point with 4 fractional bits
+#define SUBPIXEL_BITS 4
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+/*
+ * a screen space triangle as the rasterizer consumes it, built once per triangle by the
+ * geometry stage, see raster_triangle_setup()
+ * 40 bytes, everything binning, the solid fill and the wireframe read
+ */
+typedef struct {
+        int32_t x[3];   // snapped to the subpixel grid
+        int32_t y[3];
+        float z[3];     // z/w
+        uint32_t color;
+} raster_triangle_t;
+
+// an attribute interpolated linearly in screen space: value + dx * (x - x_origin) + dy * (y - y_origin)
+// the origin is the top-left pixel of the triangle's bounding box, see setup_edge_triangle()
+typedef struct {
+        float value; // at (x_origin, y_origin)
+        float dx;
+        float dy;
+} raster_plane_t;
+
+// what only textured triangles need, in an array of its own next to the raster_triangle_t
+// array, also 40 bytes
+// 1/w, u/w and v/w are linear in screen space, their planes are set up in double precision
+// once per triangle and the rasterizer only reads them, whatever number of tiles it touches
+typedef struct {
+        raster_plane_t inv_w;
+        raster_plane_t u_w;
+        raster_plane_t v_w;
+        int lod;        // mip level of the whole triangle
+} raster_texcoords_t;
+
+void raster_triangle_setup(const triangle_t *t, const mip_level_t *mips, int num_mips, raster_triangle_t *r, raster_texcoords_t *uv);
 #endif
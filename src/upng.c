@@ -28,11 +28,17 @@ freely, subject to the following restrictions:
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "upng.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h>
+#define UPNG_SIMD_X86
+#endif
+
 #define MAKE_BYTE(b) ((b) & 0xFF)
-#define MAKE_DWORD(a,b,c,d) ((MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
+#define MAKE_DWORD(a,b,c,d) (((unsigned)MAKE_BYTE(a) << 24) | (MAKE_BYTE(b) << 16) | (MAKE_BYTE(c) << 8) | MAKE_BYTE(d))
 #define MAKE_DWORD_PTR(p) MAKE_DWORD((p)[0], (p)[1], (p)[2], (p)[3])
 
 #define CHUNK_IHDR MAKE_DWORD('I','H','D','R')
@@ -56,6 +62,11 @@ freely, subject to the following restrictions:
 #define DISTANCE_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
 #define CODE_LENGTH_BUFFER_SIZE (NUM_DISTANCE_SYMBOLS * 2)
 
+#define HUFFMAN_TABLE_BITS 9	/*number of bits huffman_decode_symbol resolves with one table lookup, every code of the fixed trees and most codes of dynamic trees fit */
+#define HUFFMAN_TABLE_SIZE (1 << HUFFMAN_TABLE_BITS)
+#define HUFFMAN_ENTRY_SUBTREE 0x100000	/*the code is longer than HUFFMAN_TABLE_BITS, the entry holds the tree2d node the rest of it starts at */
+#define HUFFMAN_ENTRY_INVALID 0x200000	/*the bits lead out of the tree */
+
 #define SET_ERROR(upng,code) do { (upng)->error = (code); (upng)->error_line = __LINE__; } while (0)
 
 #define upng_chunk_length(chunk) MAKE_DWORD_PTR(chunk)
@@ -102,6 +113,7 @@ struct upng_t {
 
 typedef struct huffman_tree {
 	unsigned* tree2d;
+	unsigned table[HUFFMAN_TABLE_SIZE];	/*indexed by the next HUFFMAN_TABLE_BITS input bits: the symbol or node in bits 0-15, the number of bits it consumes in bits 16-19, HUFFMAN_ENTRY_* flags */
 	unsigned maxbitlen;	/*maximum number of bits a single code can get */
 	unsigned numcodes;	/*number of symbols in the alphabet = number of codes */
 } huffman_tree;
@@ -176,21 +188,35 @@ static const unsigned FIXED_DISTANCE_TREE[NUM_DISTANCE_SYMBOLS * 2] = {
 	29, 30, 31, 0, 0
 };
 
-static unsigned char read_bit(unsigned long *bitpointer, const unsigned char *bitstream)
+/*the input from bitpointer on, at least 57 bits of it. Deflate packs its bits starting at the lsb of each byte, so the window is the 8 bytes at bitpointer read as a little endian number. Past the end of the input the window is filled with zeros, the callers check bitpointer against inlength after consuming bits */
+static uint64_t peek_bits(const unsigned char *bitstream, unsigned long inlength, unsigned long bitpointer)
 {
-	unsigned char result = (unsigned char)((bitstream[(*bitpointer) >> 3] >> ((*bitpointer) & 0x7)) & 1);
-	(*bitpointer)++;
-	return result;
+	unsigned long p = bitpointer >> 3;
+	uint64_t window = 0;
+	unsigned i;
+
+	if (p + 8 <= inlength) {
+		/* compilers turn this into a single load on little endian targets */
+		window = (uint64_t)bitstream[p] | ((uint64_t)bitstream[p + 1] << 8) | ((uint64_t)bitstream[p + 2] << 16) | ((uint64_t)bitstream[p + 3] << 24) |
+			((uint64_t)bitstream[p + 4] << 32) | ((uint64_t)bitstream[p + 5] << 40) | ((uint64_t)bitstream[p + 6] << 48) | ((uint64_t)bitstream[p + 7] << 56);
+	} else {
+		for (i = 0; p + i < inlength; i++) {
+			window |= (uint64_t)bitstream[p + i] << (8 * i);
+		}
+	}
+
+	return window >> (bitpointer & 0x7);
 }
 
-static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long nbits)
+static unsigned read_bits(unsigned long *bitpointer, const unsigned char *bitstream, unsigned long inlength, unsigned long nbits)
 {
-	unsigned result = 0, i;
-	for (i = 0; i < nbits; i++)
-		result |= ((unsigned)read_bit(bitpointer, bitstream)) << i;
+	unsigned result = (unsigned)(peek_bits(bitstream, inlength, *bitpointer) & ((1u << nbits) - 1));
+	(*bitpointer) += nbits;
 	return result;
 }
 
+static void huffman_tree_create_table(huffman_tree* tree);
+
 /* the buffer must be numcodes*2 in size! */
 static void huffman_tree_init(huffman_tree* tree, unsigned* buffer, unsigned numcodes, unsigned maxbitlen)
 {
@@ -266,32 +292,79 @@ static void huffman_tree_create_lengths(upng_t* upng, huffman_tree* tree, const
 			tree->tree2d[n] = 0;	/*remove possible remaining 32767's */
 		}
 	}
+
+	huffman_tree_create_table(tree);
 }
 
-static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+/*the next code is the same for every input that starts with the same bits, so walk tree2d once for every possible HUFFMAN_TABLE_BITS bits and store where each walk ends: at a symbol after so many bits, at a node for longer codes, or outside of the tree */
+static void huffman_tree_create_table(huffman_tree* tree)
 {
-	unsigned treepos = 0, ct;
-	unsigned char bit;
-	for (;;) {
-		/* error: end of input memory reached without endcode */
-		if (((*bp) & 0x07) == 0 && ((*bp) >> 3) > inlength) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
-		}
+	unsigned index, i;
+
+	for (index = 0; index < HUFFMAN_TABLE_SIZE; index++) {
+		unsigned treepos = 0, entry = HUFFMAN_ENTRY_INVALID;
+
+		for (i = 0; i < HUFFMAN_TABLE_BITS; i++) {
+			unsigned ct = tree->tree2d[(treepos << 1) | ((index >> i) & 1)];
+			if (ct < tree->numcodes) {
+				entry = ct | ((i + 1) << 16);
+				break;
+			}
 
-		bit = read_bit(bp, in);
+			treepos = ct - tree->numcodes;
+			if (treepos >= tree->numcodes) {
+				break;
+			}
+		}
 
-		ct = codetree->tree2d[(treepos << 1) | bit];
-		if (ct < codetree->numcodes) {
-			return ct;
+		if (i == HUFFMAN_TABLE_BITS) {
+			entry = treepos | (HUFFMAN_TABLE_BITS << 16) | HUFFMAN_ENTRY_SUBTREE;
 		}
+		tree->table[index] = entry;
+	}
+}
 
-		treepos = ct - codetree->numcodes;
-		if (treepos >= codetree->numcodes) {
-			SET_ERROR(upng, UPNG_EMALFORMED);
-			return 0;
+static unsigned huffman_decode_symbol(upng_t *upng, const unsigned char *in, unsigned long *bp, const huffman_tree* codetree, unsigned long inlength)
+{
+	uint64_t bits = peek_bits(in, inlength, *bp);
+	unsigned entry = codetree->table[bits & (HUFFMAN_TABLE_SIZE - 1)];
+	unsigned treepos, ct;
+
+	if (entry & HUFFMAN_ENTRY_INVALID) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+
+	(*bp) += (entry >> 16) & 0xF;
+	ct = entry & 0xFFFF;
+
+	if (entry & HUFFMAN_ENTRY_SUBTREE) {
+		/* a long code, walk the rest of it from the node the table ended at. Codes have at most MAX_BIT_LENGTH bits, so the window still holds all of them */
+		treepos = ct;
+		bits >>= HUFFMAN_TABLE_BITS;
+		for (;;) {
+			ct = codetree->tree2d[(treepos << 1) | (unsigned)(bits & 1)];
+			bits >>= 1;
+			(*bp)++;
+			if (ct < codetree->numcodes) {
+				break;
+			}
+
+			treepos = ct - codetree->numcodes;
+			if (treepos >= codetree->numcodes) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return 0;
+			}
 		}
 	}
+
+	/* error: end of input memory reached without endcode, the code was completed with the zeros past the end */
+	if ((*bp) > inlength * 8) {
+		SET_ERROR(upng, UPNG_EMALFORMED);
+		return 0;
+	}
+
+	return ct;
 }
 
 /* get the tree of a deflated block with dynamic tree, the tree itself is also Huffman compressed with a known tree*/
@@ -314,13 +387,13 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 	memset(bitlenD, 0, sizeof(bitlenD));
 
 	/*the bit pointer is or will go past the memory */
-	hlit = read_bits(bp, in, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
-	hdist = read_bits(bp, in, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
-	hclen = read_bits(bp, in, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
+	hlit = read_bits(bp, in, inlength, 5) + 257;	/*number of literal/length codes + 257. Unlike the spec, the value 257 is added to it here already */
+	hdist = read_bits(bp, in, inlength, 5) + 1;	/*number of distance codes. Unlike the spec, the value 1 is added to it here already */
+	hclen = read_bits(bp, in, inlength, 4) + 4;	/*number of code length codes. Unlike the spec, the value 4 is added to it here already */
 
 	for (i = 0; i < NUM_CODE_LENGTH_CODES; i++) {
 		if (i < hclen) {
-			codelengthcode[CLCL[i]] = read_bits(bp, in, 3);
+			codelengthcode[CLCL[i]] = read_bits(bp, in, inlength, 3);
 		} else {
 			codelengthcode[CLCL[i]] = 0;	/*if not, it must stay 0 */
 		}
@@ -352,12 +425,12 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 			unsigned replength = 3;	/*read in the 2 bits that indicate repeat length (3-6) */
 			unsigned value;	/*set value to the previous code */
 
-			if ((*bp) >> 3 >= inlength) {
+			/* error: there is no previous code, or the bit pointer jumps past memory */
+			if (i == 0 || (*bp) >> 3 >= inlength) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				break;
 			}
-			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 2);
+			replength += read_bits(bp, in, inlength, 2);
 
 			if ((i - 1) < hlit) {
 				value = bitlen[i - 1];
@@ -388,7 +461,7 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 			}
 
 			/*error, bit pointer jumps past memory */
-			replength += read_bits(bp, in, 3);
+			replength += read_bits(bp, in, inlength, 3);
 
 			/*repeat this value in the next lengths */
 			for (n = 0; n < replength; n++) {
@@ -413,7 +486,7 @@ static void get_tree_inflate_dynamic(upng_t* upng, huffman_tree* codetree, huffm
 				break;
 			}
 
-			replength += read_bits(bp, in, 7);
+			replength += read_bits(bp, in, inlength, 7);
 
 			/*repeat this value in the next lengths */
 			for (n = 0; n < replength; n++) {
@@ -463,6 +536,8 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 		/* fixed trees */
 		huffman_tree_init(&codetree, (unsigned*)FIXED_DEFLATE_CODE_TREE, NUM_DEFLATE_CODE_SYMBOLS, DEFLATE_CODE_BITLEN);
 		huffman_tree_init(&codetreeD, (unsigned*)FIXED_DISTANCE_TREE, NUM_DISTANCE_SYMBOLS, DISTANCE_BITLEN);
+		huffman_tree_create_table(&codetree);
+		huffman_tree_create_table(&codetreeD);
 	} else if (btype == 2) {
 		/* dynamic trees */
 		unsigned codelengthcodetree_buffer[CODE_LENGTH_BUFFER_SIZE];
@@ -506,7 +581,7 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
-			length += read_bits(bp, in, numextrabits);
+			length += read_bits(bp, in, inlength, numextrabits);
 
 			/*part 3: get distance code */
 			codeD = huffman_decode_symbol(upng, in, bp, &codetreeD, inlength);
@@ -531,13 +606,17 @@ static void inflate_huffman(upng_t* upng, unsigned char* out, unsigned long outs
 				return;
 			}
 
-			distance += read_bits(bp, in, numextrabitsD);
+			distance += read_bits(bp, in, inlength, numextrabitsD);
 
 			/*part 5: fill in all the out[n] values based on the length and dist */
 			start = (*pos);
+			if (distance > start) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				return;
+			}
 			backward = start - distance;
 
-			if ((*pos) + length >= outsize) {
+			if ((*pos) + length > outsize) {
 				SET_ERROR(upng, UPNG_EMALFORMED);
 				return;
 			}
@@ -566,7 +645,7 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 	p = (*bp) / 8;		/*byte position */
 
 	/* read len (2 bytes) and nlen (2 bytes) */
-	if (p >= inlength - 4) {
+	if (p + 4 > inlength) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
@@ -582,7 +661,7 @@ static void inflate_uncompressed(upng_t* upng, unsigned char* out, unsigned long
 		return;
 	}
 
-	if ((*pos) + len >= outsize) {
+	if ((*pos) + len > outsize) {
 		SET_ERROR(upng, UPNG_EMALFORMED);
 		return;
 	}
@@ -608,6 +687,10 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 
 	unsigned done = 0;
 
+	/* the deflate blocks start after the zlib header, bit positions are relative to them */
+	in += inpos;
+	insize -= inpos;
+
 	while (done == 0) {
 		unsigned btype;
 
@@ -618,17 +701,17 @@ static upng_error uz_inflate_data(upng_t* upng, unsigned char* out, unsigned lon
 		}
 
 		/* read block control bits */
-		done = read_bit(&bp, &in[inpos]);
-		btype = read_bit(&bp, &in[inpos]) | (read_bit(&bp, &in[inpos]) << 1);
+		done = read_bits(&bp, in, insize, 1);
+		btype = read_bits(&bp, in, insize, 2);
 
 		/* process control type appropriateyly */
 		if (btype == 3) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
 			return upng->error;
 		} else if (btype == 0) {
-			inflate_uncompressed(upng, out, outsize, &in[inpos], &bp, &pos, insize);	/*no compression */
+			inflate_uncompressed(upng, out, outsize, in, &bp, &pos, insize);	/*no compression */
 		} else {
-			inflate_huffman(upng, out, outsize, &in[inpos], &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
+			inflate_huffman(upng, out, outsize, in, &bp, &pos, insize, btype);	/*compression, btype 01 or 10 */
 		}
 
 		/* stop if an error has occured */
@@ -688,6 +771,135 @@ static int paeth_predictor(int a, int b, int c)
 		return c;
 }
 
+static int upng_simd = 1;
+
+void upng_set_simd(int enabled)
+{
+	upng_simd = enabled;
+}
+
+#ifdef UPNG_SIMD_X86
+static int upng_has_sse2(void)
+{
+	return upng_simd && __builtin_cpu_supports("sse2");
+}
+
+/*the 3 or 4 bytes of one pixel in the low lanes*/
+__attribute__((target("sse2")))
+static __m128i load_pixel(const unsigned char *p, unsigned long bytewidth)
+{
+	unsigned v = p[0] | ((unsigned)p[1] << 8) | ((unsigned)p[2] << 16);
+	if (bytewidth == 4) {
+		v |= (unsigned)p[3] << 24;
+	}
+	return _mm_cvtsi32_si128((int)v);
+}
+
+__attribute__((target("sse2")))
+static void store_pixel(unsigned char *p, __m128i v)
+{
+	unsigned u = (unsigned)_mm_cvtsi128_si32(v);
+	memcpy(p, &u, 4);
+}
+
+/*Paeth predictor of all channels of a pixel at once, a b and c are widened to 16 bits. Same decisions as paeth_predictor: p - a = b - c, p - b = a - c, p - c = (b - c) + (a - c)*/
+__attribute__((target("sse2")))
+static __m128i paeth_predictor_sse2(__m128i a, __m128i b, __m128i c)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i bc = _mm_sub_epi16(b, c);
+	__m128i ac = _mm_sub_epi16(a, c);
+	__m128i abc = _mm_add_epi16(bc, ac);
+	__m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+	__m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+	__m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+	__m128i min_bc = _mm_min_epi16(pb, pc);
+
+	/* pb <= pc ? b : c, then a where pa <= pb and pa <= pc */
+	__m128i use_b = _mm_cmpeq_epi16(pb, min_bc);
+	__m128i pred = _mm_or_si128(_mm_and_si128(use_b, b), _mm_andnot_si128(use_b, c));
+	__m128i not_a = _mm_cmpgt_epi16(pa, min_bc);
+	return _mm_or_si128(_mm_and_si128(not_a, pred), _mm_andnot_si128(not_a, a));
+}
+
+/*
+   unfilter_scanline for count pixels of 3 or 4 bytes with a previous scanline, each pixel is unfiltered as a whole in one register
+   recon always gets 4 bytes per pixel: bytewidth 4 is stored as it is, bytewidth 3 is expanded to RGBA with an opaque alpha, precon is in the layout of recon
+   recon may be scanline or lie before it (scanlines are compacted in place), every pixel is read before it can be overwritten
+   return value is 0 for an unknown filter type
+ */
+__attribute__((target("sse2")))
+static int unfilter_pixels_sse2(unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long count)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha = _mm_cvtsi32_si128(bytewidth == 3 ? (int)0xFF000000u : 0);
+	__m128i a = zero, b, c = zero, x;
+	unsigned long i = 0;
+
+	switch (filterType) {
+	case 0:
+		for (; i < count; i++) {
+			store_pixel(&recon[i * 4], _mm_or_si128(load_pixel(&scanline[i * bytewidth], bytewidth), alpha));
+		}
+		return 1;
+	case 1:
+		if (bytewidth == 4) {
+			/* 4 pixels per step: prefix sum over the pixels of the register plus the last pixel of the previous step */
+			for (; i + 4 <= count; i += 4) {
+				x = _mm_loadu_si128((const __m128i*)&scanline[i * 4]);
+				x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+				x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+				x = _mm_add_epi8(x, a);
+				_mm_storeu_si128((__m128i*)&recon[i * 4], x);
+				a = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+			}
+			a = _mm_srli_si128(a, 12);
+		}
+		for (; i < count; i++) {
+			a = _mm_add_epi8(load_pixel(&scanline[i * bytewidth], bytewidth), a);
+			store_pixel(&recon[i * 4], _mm_or_si128(a, alpha));
+		}
+		return 1;
+	case 2:
+		if (bytewidth == 4) {
+			for (; i + 4 <= count; i += 4) {
+				x = _mm_loadu_si128((const __m128i*)&scanline[i * 4]);
+				b = _mm_loadu_si128((const __m128i*)&precon[i * 4]);
+				_mm_storeu_si128((__m128i*)&recon[i * 4], _mm_add_epi8(x, b));
+			}
+		}
+		for (; i < count; i++) {
+			x = load_pixel(&scanline[i * bytewidth], bytewidth);
+			b = load_pixel(&precon[i * 4], 4);
+			store_pixel(&recon[i * 4], _mm_or_si128(_mm_add_epi8(x, b), alpha));
+		}
+		return 1;
+	case 3:
+		for (; i < count; i++) {
+			/* floor((a + b) / 2), pavgb rounds up */
+			b = load_pixel(&precon[i * 4], 4);
+			x = load_pixel(&scanline[i * bytewidth], bytewidth);
+			x = _mm_add_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1))));
+			a = x;
+			store_pixel(&recon[i * 4], _mm_or_si128(x, alpha));
+		}
+		return 1;
+	case 4:
+		for (; i < count; i++) {
+			b = _mm_unpacklo_epi8(load_pixel(&precon[i * 4], 4), zero);
+			x = load_pixel(&scanline[i * bytewidth], bytewidth);
+			x = _mm_add_epi8(x, _mm_packus_epi16(paeth_predictor_sse2(a, b, c), zero));
+			a = _mm_unpacklo_epi8(x, zero);
+			c = b;
+			store_pixel(&recon[i * 4], _mm_or_si128(x, alpha));
+		}
+		return 1;
+	default:
+		return 0;
+	}
+}
+#endif
+
 static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned char *scanline, const unsigned char *precon, unsigned long bytewidth, unsigned char filterType, unsigned long length)
 {
 	/*
@@ -699,6 +911,16 @@ static void unfilter_scanline(upng_t* upng, unsigned char *recon, const unsigned
 	 */
 
 	unsigned long i;
+
+#ifdef UPNG_SIMD_X86
+	if (precon && bytewidth == 4 && upng_has_sse2()) {
+		if (!unfilter_pixels_sse2(recon, scanline, precon, bytewidth, filterType, length / 4)) {
+			SET_ERROR(upng, UPNG_EMALFORMED);
+		}
+		return;
+	}
+#endif
+
 	switch (filterType) {
 	case 0:
 		for (i = 0; i < length; i++)
@@ -830,6 +1052,75 @@ static void post_process_scanlines(upng_t* upng, unsigned char *out, unsigned ch
 	}
 }
 
+/*
+   unfilter the scanlines of an 8 bit RGB or RGBA image and write them as RGBA, one scanline at a time: each pixel is unfiltered and stored in its final layout in the same step, so the image is read and written once
+   bytewidth is 3 or 4. in may lie inside out, as long as it starts at or after out and ends at or before its end: an output row never reaches the part of in that is still unread (see upng_get_rgba8_size)
+ */
+static void unfilter_rgba8(upng_t* upng, unsigned char *out, unsigned char *in, unsigned w, unsigned h, unsigned long bytewidth)
+{
+	unsigned long linebytes = w * bytewidth;
+	unsigned long outbytes = (unsigned long)w * 4;
+	unsigned char *prevline = NULL;	/*scalar RGB path: copy of the previous unfiltered scanline, the output may already cover it in in */
+	int simd = 0;
+	unsigned y;
+
+#ifdef UPNG_SIMD_X86
+	simd = upng_has_sse2();
+#endif
+
+	if (!simd && bytewidth == 3 && h > 1) {
+		prevline = (unsigned char*)malloc(linebytes);
+		if (prevline == NULL) {
+			SET_ERROR(upng, UPNG_ENOMEM);
+			return;
+		}
+	}
+
+	for (y = 0; y < h; y++) {
+		unsigned char *recon = &out[outbytes * y];
+		unsigned char *scanline = &in[(1 + linebytes) * y + 1];
+		unsigned char filterType = scanline[-1];
+		unsigned long x;
+
+#ifdef UPNG_SIMD_X86
+		if (simd && y > 0) {
+			if (!unfilter_pixels_sse2(recon, scanline, recon - outbytes, bytewidth, filterType, w)) {
+				SET_ERROR(upng, UPNG_EMALFORMED);
+				break;
+			}
+			continue;
+		}
+#endif
+
+		if (bytewidth == 4) {
+			unfilter_scanline(upng, recon, scanline, y > 0 ? recon - outbytes : NULL, 4, filterType, linebytes);
+			if (upng->error != UPNG_EOK) {
+				break;
+			}
+			continue;
+		}
+
+		/* RGB: unfilter in place, keep a copy for the next scanline, then expand */
+		unfilter_scanline(upng, scanline, scanline, y > 0 ? prevline : NULL, 3, filterType, linebytes);
+		if (upng->error != UPNG_EOK) {
+			break;
+		}
+		if (prevline != NULL) {
+			memcpy(prevline, scanline, linebytes);
+		}
+
+		for (x = 0; x < w; x++) {
+			unsigned char r = scanline[3 * x + 0], g = scanline[3 * x + 1], b = scanline[3 * x + 2];
+			recon[4 * x + 0] = r;
+			recon[4 * x + 1] = g;
+			recon[4 * x + 2] = b;
+			recon[4 * x + 3] = 255;
+		}
+	}
+
+	free(prevline);
+}
+
 static upng_format determine_format(upng_t* upng) {
 	switch (upng->color_type) {
 	case UPNG_LUM:
@@ -960,30 +1251,23 @@ upng_error upng_header(upng_t* upng)
 	return upng->error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-upng_error upng_decode(upng_t* upng)
+/*make sure the header is parsed and the image is ready to be decoded. return value is 0 if it isn't, with the error set if there is one*/
+static int upng_ready(upng_t* upng)
 {
-	const unsigned char *chunk;
-	unsigned char* compressed;
-	unsigned char* inflated;
-	unsigned long compressed_size = 0, compressed_index = 0;
-	unsigned long inflated_size;
-	upng_error error;
-
 	/* if we have an error state, bail now */
 	if (upng->error != UPNG_EOK) {
-		return upng->error;
+		return 0;
 	}
 
 	/* parse the main header, if necessary */
 	upng_header(upng);
 	if (upng->error != UPNG_EOK) {
-		return upng->error;
+		return 0;
 	}
 
 	/* if the state is not HEADER (meaning we are ready to decode the image), stop now */
 	if (upng->state != UPNG_HEADER) {
-		return upng->error;
+		return 0;
 	}
 
 	/* release old result, if any */
@@ -993,6 +1277,22 @@ upng_error upng_decode(upng_t* upng)
 		upng->size = 0;
 	}
 
+	return 1;
+}
+
+/*
+   inflate the concatenated IDAT chunks into inflated: the filtered scanlines, each with its filter type byte in front
+   the source is not needed after this and is freed, whether inflating worked or not
+   the IDAT data is only copied when it has to be: a single chunk is inflated where it is, the chunks of a source buffer we own are moved together in place
+ */
+static upng_error upng_inflate_image(upng_t* upng, unsigned char* inflated, unsigned long inflated_size)
+{
+	const unsigned char *chunk;
+	const unsigned char *first_data = NULL;
+	unsigned char* compressed = NULL;
+	unsigned long compressed_size = 0, compressed_index = 0;
+	unsigned long num_chunks = 0;
+
 	/* first byte of the first chunk after the header */
 	chunk = upng->source.buffer + 33;
 
@@ -1005,20 +1305,20 @@ upng_error upng_decode(upng_t* upng)
 		/* make sure chunk header is not larger than the total compressed */
 		if ((unsigned long)(chunk - upng->source.buffer + 12) > upng->source.size) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			break;
 		}
 
 		/* get length; sanity check it */
 		length = upng_chunk_length(chunk);
 		if (length > INT_MAX) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			break;
 		}
 
 		/* make sure chunk header+paylaod is not larger than the total compressed */
 		if ((unsigned long)(chunk - upng->source.buffer + length + 12) > upng->source.size) {
 			SET_ERROR(upng, UPNG_EMALFORMED);
-			return upng->error;
+			break;
 		}
 
 		/* get pointer to payload */
@@ -1026,65 +1326,94 @@ upng_error upng_decode(upng_t* upng)
 
 		/* parse chunks */
 		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+			if (num_chunks++ == 0) {
+				first_data = data;
+			}
 			compressed_size += length;
 		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
 			break;
 		} else if (upng_chunk_critical(chunk)) {
 			SET_ERROR(upng, UPNG_EUNSUPPORTED);
-			return upng->error;
+			break;
 		}
 
 		chunk += upng_chunk_length(chunk) + 12;
 	}
 
-	/* allocate enough space for the (compressed and filtered) image data */
-	compressed = (unsigned char*)malloc(compressed_size);
-	if (compressed == NULL) {
-		SET_ERROR(upng, UPNG_ENOMEM);
-		return upng->error;
+	if (upng->error == UPNG_EOK && num_chunks > 1) {
+		/* move the payloads together at the start of our own source buffer, the write position never passes the next chunk header.
+		 * otherwise allocate enough space for the (compressed and filtered) image data */
+		if (upng->source.owning != 0) {
+			compressed = (unsigned char*)upng->source.buffer;
+		} else {
+			compressed = (unsigned char*)malloc(compressed_size);
+			if (compressed == NULL) {
+				SET_ERROR(upng, UPNG_ENOMEM);
+			}
+		}
+
+		/* scan through the chunks again, this time copying the values into
+		 * our compressed buffer.  there's no reason to validate anything a second time. */
+		chunk = upng->source.buffer + 33;
+		while (compressed != NULL && chunk < upng->source.buffer + upng->source.size) {
+			unsigned long length;
+			const unsigned char *data;	/*the data in the chunk */
+
+			length = upng_chunk_length(chunk);
+			data = chunk + 8;
+
+			/* parse chunks */
+			if (upng_chunk_type(chunk) == CHUNK_IDAT) {
+				memmove(compressed + compressed_index, data, length);
+				compressed_index += length;
+			} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
+				break;
+			}
+
+			chunk += length + 12;
+		}
+		first_data = compressed;
 	}
 
-	/* scan through the chunks again, this time copying the values into
-	 * our compressed buffer.  there's no reason to validate anything a second time. */
-	chunk = upng->source.buffer + 33;
-	while (chunk < upng->source.buffer + upng->source.size) {
-		unsigned long length;
-		const unsigned char *data;	/*the data in the chunk */
+	/* decompress image data */
+	if (upng->error == UPNG_EOK) {
+		uz_inflate(upng, inflated, inflated_size, first_data, compressed_size);
+	}
 
-		length = upng_chunk_length(chunk);
-		data = chunk + 8;
+	/* free the compressed compressed data, and the input buffer if we own it */
+	if (compressed != NULL && compressed != upng->source.buffer) {
+		free(compressed);
+	}
+	upng_free_source(upng);
 
-		/* parse chunks */
-		if (upng_chunk_type(chunk) == CHUNK_IDAT) {
-			memcpy(compressed + compressed_index, data, length);
-			compressed_index += length;
-		} else if (upng_chunk_type(chunk) == CHUNK_IEND) {
-			break;
-		}
+	return upng->error;
+}
 
-		chunk += upng_chunk_length(chunk) + 12;
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+upng_error upng_decode(upng_t* upng)
+{
+	unsigned char* inflated;
+	unsigned long inflated_size;
+
+	if (!upng_ready(upng)) {
+		return upng->error;
 	}
 
 	/* allocate space to store inflated (but still filtered) data */
 	inflated_size = ((upng->width * (upng->height * upng_get_bpp(upng) + 7)) / 8) + upng->height;
 	inflated = (unsigned char*)malloc(inflated_size);
 	if (inflated == NULL) {
-		free(compressed);
 		SET_ERROR(upng, UPNG_ENOMEM);
+		upng_free_source(upng);
 		return upng->error;
 	}
 
 	/* decompress image data */
-	error = uz_inflate(upng, inflated, inflated_size, compressed, compressed_size);
-	if (error != UPNG_EOK) {
-		free(compressed);
+	if (upng_inflate_image(upng, inflated, inflated_size) != UPNG_EOK) {
 		free(inflated);
 		return upng->error;
 	}
 
-	/* free the compressed compressed data */
-	free(compressed);
-
 	/* allocate final image buffer */
 	upng->size = (upng->height * upng->width * upng_get_bpp(upng) + 7) / 8;
 	upng->buffer = (unsigned char*)malloc(upng->size);
@@ -1107,8 +1436,109 @@ upng_error upng_decode(upng_t* upng)
 		upng->state = UPNG_DECODED;
 	}
 
-	/* we are done with our input buffer; free it if we own it */
-	upng_free_source(upng);
+	return upng->error;
+}
+
+/*
+   bytes of the buffer upng_decode_rgba8_into needs, available after upng_header, 0 for formats it can't decode
+   the buffer holds the inflated scanlines at its end while they are unfiltered towards its start: that's the RGBA image for RGB, the filter type bytes don't fit for RGBA
+ */
+unsigned long upng_get_rgba8_size(const upng_t* upng)
+{
+	unsigned long image_size = (unsigned long)upng->width * upng->height * 4;
+
+	if (upng->state != UPNG_HEADER) {
+		return 0;
+	}
+
+	switch (upng->format) {
+	case UPNG_RGB8:
+		return image_size;
+	case UPNG_RGBA8:
+		return image_size + upng->height;
+	default:
+		return 0;
+	}
+}
+
+/*
+   read an 8 bit RGB or RGBA PNG into out, the result is always 8 bit RGBA and starts at out
+   size must be at least upng_get_rgba8_size, nothing else is allocated apart from the joined IDAT data of a source we don't own
+ */
+upng_error upng_decode_rgba8_into(upng_t* upng, unsigned char* out, unsigned long size)
+{
+	unsigned long bytewidth, inflated_size;
+	unsigned char* inflated;
+
+	if (!upng_ready(upng)) {
+		return upng->error;
+	}
+
+	if (upng->format != UPNG_RGB8 && upng->format != UPNG_RGBA8) {
+		SET_ERROR(upng, UPNG_EUNFORMAT);
+		return upng->error;
+	}
+
+	if (out == NULL || size < upng_get_rgba8_size(upng)) {
+		SET_ERROR(upng, UPNG_EPARAM);
+		return upng->error;
+	}
+
+	/* the scanlines are inflated into the end of out, the unfiltered rows follow them from its start */
+	bytewidth = upng->format == UPNG_RGB8 ? 3 : 4;
+	inflated_size = (1 + upng->width * bytewidth) * upng->height;
+	inflated = out + size - inflated_size;
+
+	if (upng_inflate_image(upng, inflated, inflated_size) != UPNG_EOK) {
+		return upng->error;
+	}
+
+	unfilter_rgba8(upng, out, inflated, upng->width, upng->height, bytewidth);
+	if (upng->error == UPNG_EOK) {
+		upng->color_type = UPNG_RGBA;
+		upng->color_depth = 8;
+		upng->format = UPNG_RGBA8;
+		upng->state = UPNG_DECODED;
+	}
+
+	return upng->error;
+}
+
+/*read an 8 bit RGB or RGBA PNG, the result is always 8 bit RGBA*/
+upng_error upng_decode_rgba8(upng_t* upng)
+{
+	unsigned long size;
+	unsigned char* out;
+	unsigned char* shrunk;
+
+	if (!upng_ready(upng)) {
+		return upng->error;
+	}
+
+	size = upng_get_rgba8_size(upng);
+	if (size == 0) {
+		SET_ERROR(upng, UPNG_EUNFORMAT);
+		return upng->error;
+	}
+
+	out = (unsigned char*)malloc(size);
+	if (out == NULL) {
+		SET_ERROR(upng, UPNG_ENOMEM);
+		return upng->error;
+	}
+
+	if (upng_decode_rgba8_into(upng, out, size) != UPNG_EOK) {
+		free(out);
+		return upng->error;
+	}
+
+	/* give back the filter type bytes at the end, shrinking doesn't move the buffer */
+	upng->size = (unsigned long)upng->width * upng->height * 4;
+	shrunk = (unsigned char*)realloc(out, upng->size);
+	if (shrunk != NULL) {
+		out = shrunk;
+	}
+	upng->buffer = out;
 
 	return upng->error;
 }
@@ -63,6 +63,8 @@ void		upng_free			(upng_t* upng);
 
 upng_error	upng_header			(upng_t* upng);
 upng_error	upng_decode			(upng_t* upng);
+upng_error	upng_decode_rgba8	(upng_t* upng);	/* 8 bit RGB or RGBA images only, the result is always RGBA */
+upng_error	upng_decode_rgba8_into	(upng_t* upng, unsigned char* out, unsigned long size);	/* the same into a buffer of the caller, the image starts at out */
 
 upng_error	upng_get_error		(const upng_t* upng);
 unsigned	upng_get_error_line	(const upng_t* upng);
@@ -77,5 +79,8 @@ upng_format	upng_get_format		(const upng_t* upng);
 
 const unsigned char*	upng_get_buffer		(const upng_t* upng);
 unsigned				upng_get_size		(const upng_t* upng);
+unsigned long			upng_get_rgba8_size	(const upng_t* upng);	/* size of the buffer for upng_decode_rgba8_into, after upng_header */
+
+void	upng_set_simd	(int enabled);	/* 0 decodes with the portable code only, for every image from then on */
 
 #endif /*defined(UPNG_H)*/
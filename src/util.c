@@ -1,7 +1,17 @@
+#if defined(__unix__) || defined(__APPLE__)
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define UTIL_HAS_MMAP
+#endif
 #include <string.h>
 #include "util.h"
 #include <math.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 void swap(char *a, char *b, int size) {
         char tmp[size];
@@ -23,3 +33,113 @@ float float_lerp(float a, float b, float t) {
         //I = Q1 + t < Q2 − Q1 >
         return a + t * (b - a);
 }
+
+static bool scalar_only = false;
+
+// every simd path reports as unsupported from now on, set before any work starts
+void cpu_force_scalar(void) {
+        scalar_only = true;
+}
+
+// runtime cpu feature checks for the simd paths
+bool cpu_has_sse2(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        return !scalar_only && __builtin_cpu_supports("sse2");
+#else
+        return false;
+#endif
+}
+
+bool cpu_has_avx2(void) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        return !scalar_only && __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+// read-only view of a whole file
+// mapped where mmap is available, pages are only read in when touched and nothing
+// is copied, elsewhere the file is read into memory
+/////////////////////////////////////////////////////////////////////////////////////////
+bool map_file(const char *path, file_view_t *view) {
+        view->data = NULL;
+        view->size = 0;
+        view->mapped = false;
+
+#ifdef UTIL_HAS_MMAP
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                close(fd);
+                return false;
+        }
+
+        // mmap doesn't take empty files
+        view->size = (size_t)st.st_size;
+        if (view->size > 0) {
+                void *data = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                        close(fd);
+                        return false;
+                }
+                view->data = (const char *)data;
+                view->mapped = true;
+        }
+        close(fd);
+        return true;
+#else
+        FILE *fp = fopen(path, "rb");
+        if (!fp) return false;
+
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        char *data = size > 0 ? (char *)malloc(size) : NULL;
+        bool ok = size >= 0 && (size == 0 || (data && fread(data, 1, size, fp) == (size_t)size));
+        fclose(fp);
+        if (!ok) {
+                free(data);
+                return false;
+        }
+
+        view->data = data;
+        view->size = (size_t)size;
+        return true;
+#endif
+}
+
+// size and modification time (nanoseconds) of a file, false when unknown
+// whole seconds would miss a change written within the second of the last one
+bool file_info(const char *path, uint64_t *size, int64_t *mtime) {
+#ifdef UTIL_HAS_MMAP
+        struct stat st;
+        if (stat(path, &st) != 0) return false;
+        *size = (uint64_t)st.st_size;
+#ifdef __APPLE__
+        *mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+        *mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+        return true;
+#else
+        (void)path;
+        (void)size;
+        (void)mtime;
+        return false;
+#endif
+}
+
+void unmap_file(file_view_t *view) {
+#ifdef UTIL_HAS_MMAP
+        if (view->mapped) munmap((void *)view->data, view->size);
+#else
+        free((void *)view->data);
+#endif
+        view->data = NULL;
+        view->size = 0;
+        view->mapped = false;
+}
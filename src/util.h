@@ -2,6 +2,8 @@
 #define UTIL_H
 #include <stdbool.h>
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 // TODO(@k): why line below won't work as expected
 // #define MIN(a, b) (a > b ? b : a)
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
@@ -10,4 +12,18 @@ void swap(char *a, char *b, int size);
 bool is_float_close(float a, float b, float margin);
 void float_clamp_inline(float *d, float min, float max);
 float float_lerp(float a, float b, float t);
+void cpu_force_scalar(void);
+bool cpu_has_sse2(void);
+bool cpu_has_avx2(void);
+
+// a whole file in memory, see map_file()
+typedef struct {
+        const char *data; // not null terminated
+        size_t size;
+        bool mapped;
+} file_view_t;
+
+bool map_file(const char *path, file_view_t *view);
+void unmap_file(file_view_t *view);
+bool file_info(const char *path, uint64_t *size, int64_t *mtime);
 #endif
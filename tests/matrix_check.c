@@ -0,0 +1,123 @@
+/////////////////////////////////////////////////////////////////////////////////////////
+// mat4_mul_vec4_batch: the sse2 and avx2 kernels against the scalar one
+// random matrices and positions, every count from 0 to 67 and a few big odd ones, so the
+// 4 and 8 wide loops and their scalar tails all run
+// build and run with: make check
+/////////////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/matrix.c" // the kernels are static
+#include "../src/universe.h"
+
+#define MAX_ULPS 1 // the kernels are expected to be bit-identical, one ulp of slack
+#define MAX_COUNT 1027
+#define NUM_MATRICES 64
+
+typedef void (*batch_fn)(const mat4_t *m, const float *x, const float *y, const float *z, vec4_t *out, int count);
+
+static float random_float(float min, float max) {
+        return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
+
+// distance in representable floats, floats of different sign are compared through 0
+static uint32_t ulp_distance(float a, float b) {
+        if (a == b) return 0;
+        if (a != a || b != b) return UINT32_MAX; /* NaN */
+
+        int32_t ia, ib;
+        memcpy(&ia, &a, sizeof(ia));
+        memcpy(&ib, &b, sizeof(ib));
+        if (ia < 0) ia = INT32_MIN - ia;
+        if (ib < 0) ib = INT32_MIN - ib;
+        int64_t d = (int64_t)ia - ib;
+        return (uint32_t)(d < 0 ? -d : d);
+}
+
+// a model-view-projection like the one of a frame, or a matrix of random values
+static mat4_t random_matrix(int i) {
+        if (i % 2 == 0) {
+                mat4_t m = {{{0}}};
+                for (int r = 0; r < 4; r++) {
+                        for (int c = 0; c < 4; c++) m.m[r][c] = random_float(-10, 10);
+                }
+                return m;
+        }
+
+        mat4_t world = mat4_make_scale(random_float(0.1, 5), random_float(0.1, 5), random_float(0.1, 5));
+        world = mat4_mul_mat4(mat4_make_rotation_x(random_float(-3.2, 3.2)), world);
+        world = mat4_mul_mat4(mat4_make_rotation_y(random_float(-3.2, 3.2)), world);
+        world = mat4_mul_mat4(mat4_make_translation(random_float(-5, 5), random_float(-5, 5), random_float(1, 20)), world);
+        return mat4_mul_mat4(mat4_make_perspective(M_PI / 2, 600, 800, 1.0, 300.0), world);
+}
+
+// every count, returns the number of mismatching outputs
+static int check_kernel(const char *name, batch_fn fn, const mat4_t *m, const float *x, const float *y, const float *z, uint32_t *max_ulps) {
+        static vec4_t expected[MAX_COUNT + 1];
+        static vec4_t actual[MAX_COUNT + 1];
+        int counts[] = { 1000, 1001, 1002, 1003, 1005, 1007, MAX_COUNT };
+        int num_counts = 68 + (int)(sizeof(counts) / sizeof(counts[0]));
+
+        int failures = 0;
+        for (int c = 0; c < num_counts; c++) {
+                int count = c < 68 ? c : counts[c - 68];
+
+                // the slot after the last output has to stay untouched
+                memset(actual, 0xAB, sizeof(actual));
+                mat4_mul_vec4_batch_scalar(m, x, y, z, expected, count);
+                fn(m, x, y, z, actual, count);
+
+                for (int i = 0; i < count; i++) {
+                        const float *e = &expected[i].x;
+                        const float *a = &actual[i].x;
+                        for (int k = 0; k < 4; k++) {
+                                uint32_t d = ulp_distance(e[k], a[k]);
+                                if (d > *max_ulps) *max_ulps = d;
+                                if (d > MAX_ULPS && failures++ < 10) {
+                                        printf("%s: count %d, vertex %d, lane %d: %.9g instead of %.9g (%u ulps)\n",
+                                               name, count, i, k, a[k], e[k], d);
+                                }
+                        }
+                }
+
+                const uint8_t *guard = (const uint8_t *)&actual[count];
+                for (size_t i = 0; i < sizeof(vec4_t); i++) {
+                        if (guard[i] != 0xAB && failures++ < 10) printf("%s: count %d, wrote past the end\n", name, count);
+                }
+        }
+        return failures;
+}
+
+int main(void) {
+        srand(1234);
+
+        static float x[MAX_COUNT], y[MAX_COUNT], z[MAX_COUNT];
+        int failures = 0;
+        uint32_t max_ulps_sse2 = 0;
+        uint32_t max_ulps_avx2 = 0;
+        uint32_t max_ulps_dispatch = 0;
+        bool sse2 = false;
+        bool avx2 = false;
+
+        for (int j = 0; j < NUM_MATRICES; j++) {
+                mat4_t m = random_matrix(j);
+                for (int i = 0; i < MAX_COUNT; i++) {
+                        x[i] = random_float(-100, 100);
+                        y[i] = random_float(-100, 100);
+                        z[i] = random_float(-100, 100);
+                }
+
+#ifdef MATRIX_SIMD_X86
+                sse2 = cpu_has_sse2();
+                avx2 = cpu_has_avx2();
+                if (sse2) failures += check_kernel("sse2", mat4_mul_vec4_batch_sse2, &m, x, y, z, &max_ulps_sse2);
+                if (avx2) failures += check_kernel("avx2", mat4_mul_vec4_batch_avx2, &m, x, y, z, &max_ulps_avx2);
+#endif
+                failures += check_kernel("dispatch", mat4_mul_vec4_batch, &m, x, y, z, &max_ulps_dispatch);
+        }
+
+        printf("sse2: %s, max %u ulps\n", sse2 ? "checked" : "not supported", max_ulps_sse2);
+        printf("avx2: %s, max %u ulps\n", avx2 ? "checked" : "not supported", max_ulps_avx2);
+        printf("mat4_mul_vec4_batch: %s\n", failures == 0 ? "ok" : "FAIL");
+        return failures == 0 ? 0 : 1;
+}